@@ -0,0 +1,342 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <chrono>
+#include <fstream>
+#include <algorithm>
+#include <numeric>
+
+// repeated trials with warm-up detection, robust summary, json / csv output
+//
+//   auto opt = bench::Options::Parse(argc, argv);
+//   bench::Runner runner("picrotate", opt);
+//   runner.Run("sequence read", "fps", [&]() { ...; return fps; });
+//
+// command line: --trials=min[:max] --time=seconds --ci=0.01 --json=file --csv=file --pause
+namespace bench {
+
+struct Options {
+    int min_trials = 10;
+    int max_trials = 50;
+    double max_seconds = 30;  // per Collect, checked between trials
+    double target_ci = 0.01;  // stop once the 95% ci of the median is within +-1%
+    int warmup_window = 3;    // warm when this many consecutive trials agree within warmup_cv
+    double warmup_cv = 0.05;
+    int max_warmup = 20;
+    std::string json_path;
+    std::string csv_path;
+    bool pause = false;       // wait for enter before exit, for double-click runs
+
+    static Options Parse(int& argc, char** argv) {
+        return Parse(argc, argv, Options());
+    }
+
+    // unknown arguments are left in argv for the program, argc is updated
+    static Options Parse(int& argc, char** argv, Options opt) {
+        int out = 1;
+        for(int i = 1; i < argc; ++i) {
+            const char* a = argv[i];
+            auto value = [&](const char* key) -> const char* {
+                size_t n = strlen(key);
+                return strncmp(a, key, n) == 0 ? a + n : nullptr;
+            };
+            if (auto v = value("--trials=")) {
+                opt.min_trials = atoi(v);
+                auto colon = strchr(v, ':');
+                opt.max_trials = colon ? atoi(colon + 1) : std::max(opt.max_trials, opt.min_trials);
+            } else if (auto v = value("--time=")) {
+                opt.max_seconds = atof(v);
+            } else if (auto v = value("--ci=")) {
+                opt.target_ci = atof(v);
+            } else if (auto v = value("--json=")) {
+                opt.json_path = v;
+            } else if (auto v = value("--csv=")) {
+                opt.csv_path = v;
+            } else if (strcmp(a, "--pause") == 0) {
+                opt.pause = true;
+            } else {
+                argv[out++] = argv[i];
+            }
+        }
+        argc = out;
+        opt.min_trials = std::max(opt.min_trials, 1);
+        opt.max_trials = std::max(opt.max_trials, opt.min_trials);
+        return opt;
+    }
+};
+
+struct Stats {
+    size_t count = 0;
+    double mean = 0;
+    double stddev = 0;
+    double median = 0;
+    double p5 = 0;
+    double p95 = 0;
+    double ci_low = 0;  // 95% confidence interval of the median
+    double ci_high = 0;
+};
+
+inline double Percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty())
+        return 0;
+    double pos = p * (sorted.size() - 1);
+    size_t lo = (size_t)pos;
+    size_t hi = std::min(lo + 1, sorted.size() - 1);
+    return sorted[lo] + (sorted[hi] - sorted[lo]) * (pos - lo);
+}
+
+inline Stats Summarize(std::vector<double> samples) {
+    Stats s;
+    s.count = samples.size();
+    if (samples.empty())
+        return s;
+    std::sort(samples.begin(), samples.end());
+    s.mean = std::accumulate(samples.begin(), samples.end(), 0.0) / s.count;
+    double var = 0;
+    for(auto v: samples)
+        var += (v - s.mean) * (v - s.mean);
+    s.stddev = s.count > 1 ? std::sqrt(var / (s.count - 1)) : 0;
+    s.median = Percentile(samples, 0.5);
+    s.p5 = Percentile(samples, 0.05);
+    s.p95 = Percentile(samples, 0.95);
+    // distribution free: order statistics around n/2, normal approximation of the binomial
+    double half = 1.96 * std::sqrt((double)s.count) / 2;
+    long lo = (long)std::floor(s.count / 2.0 - half);
+    long hi = (long)std::ceil(s.count / 2.0 + half) - 1;
+    s.ci_low = samples[std::clamp<long>(lo, 0, (long)s.count - 1)];
+    s.ci_high = samples[std::clamp<long>(hi, 0, (long)s.count - 1)];
+    return s;
+}
+
+// index of the first sample after warm-up: start of the first window whose cv is small enough
+inline size_t WarmupEnd(const std::vector<double>& samples, const Options& opt) {
+    size_t w = (size_t)opt.warmup_window;
+    for(size_t i = 0; i + w <= samples.size(); ++i) {
+        double mean = 0, var = 0;
+        for(size_t j = i; j < i + w; ++j)
+            mean += samples[j];
+        mean /= w;
+        for(size_t j = i; j < i + w; ++j)
+            var += (samples[j] - mean) * (samples[j] - mean);
+        if (mean != 0 && std::sqrt(var / w) / std::abs(mean) <= opt.warmup_cv)
+            return i;
+    }
+    return samples.size();
+}
+
+// run trial() until warmed up and the median is stable, returns the measured samples only
+// trial returns one value of the metric (MB/S, ns, fps ...)
+template<class Trial>
+std::vector<double> Collect(const Options& opt, Trial&& trial) {
+    using clock = std::chrono::steady_clock;
+    auto begin = clock::now();
+    auto elapsed = [&]() { return std::chrono::duration<double>(clock::now() - begin).count(); };
+
+    std::vector<double> warm;
+    for(;;) {
+        warm.push_back(trial());
+        size_t end = WarmupEnd(warm, opt);
+        if (end < warm.size()) {
+            warm.erase(warm.begin(), warm.begin() + end);
+            break;
+        }
+        if ((int)warm.size() >= opt.max_warmup || elapsed() > opt.max_seconds) {
+            // never settled, keep the newest ones
+            warm.erase(warm.begin(), warm.end() - std::min<size_t>(warm.size(), opt.warmup_window));
+            break;
+        }
+    }
+
+    std::vector<double> samples = std::move(warm);
+    while((int)samples.size() < opt.max_trials) {
+        if ((int)samples.size() >= opt.min_trials) {
+            auto s = Summarize(samples);
+            if (s.median != 0 && (s.ci_high - s.ci_low) / 2 <= opt.target_ci * std::abs(s.median))
+                break;
+        }
+        if (samples.size() >= 3 && elapsed() > opt.max_seconds)
+            break;
+        samples.push_back(trial());
+    }
+    return samples;
+}
+
+// frequency scaling state, results are only comparable with a fixed clock
+struct SystemState {
+    std::string governor = "unknown"; // "mixed" if cpus differ
+    int turbo = -1;                   // -1 unknown, 0 off, 1 on
+
+    static SystemState Probe() {
+        SystemState st;
+#ifdef __linux__
+        auto read_line = [](const std::string& path, std::string& out) {
+            std::ifstream f(path);
+            return (bool)std::getline(f, out);
+        };
+        std::string gov;
+        for(int cpu = 0;; ++cpu) {
+            std::string g;
+            if (!read_line("/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/cpufreq/scaling_governor", g))
+                break;
+            if (gov.empty())
+                gov = g;
+            else if (gov != g)
+                gov = "mixed";
+        }
+        if (!gov.empty())
+            st.governor = gov;
+        std::string v;
+        if (read_line("/sys/devices/system/cpu/intel_pstate/no_turbo", v))
+            st.turbo = v == "0" ? 1 : 0;
+        else if (read_line("/sys/devices/system/cpu/cpufreq/boost", v))
+            st.turbo = v == "1" ? 1 : 0;
+#endif
+        return st;
+    }
+
+    void Warn() const {
+        if (governor != "performance")
+            fprintf(stderr, "warning: cpu governor is %s, not performance\n", governor.c_str());
+        if (turbo != 0)
+            fprintf(stderr, "warning: turbo is %s, clock depends on temperature\n", turbo == 1 ? "on" : "unknown");
+    }
+};
+
+// named results of one program, written to json / csv on destruction
+class Runner {
+public:
+    struct Result {
+        std::string name;
+        std::string unit;
+        std::vector<double> samples;
+        Stats stats;
+    };
+
+private:
+    std::string program_;
+    Options opt_;
+    SystemState system_;
+    std::vector<Result> results_;
+    std::map<std::string, size_t> index_;
+    std::mutex lock_;
+
+    static std::string Escape(const std::string& s) {
+        std::string r;
+        for(char c: s) {
+            if (c == '"' || c == '\\') {
+                r += '\\';
+                r += c;
+            } else if ((unsigned char)c < 0x20) {
+                char u[8];
+                snprintf(u, sizeof(u), "\\u%04x", (unsigned)(unsigned char)c);
+                r += u;
+            } else {
+                r += c;
+            }
+        }
+        return r;
+    }
+
+    // json has no nan / inf (empty or zero time samples), those are null; %g is what the stream prints
+    static std::string Number(double v) {
+        if (!std::isfinite(v))
+            return "null";
+        char b[32];
+        snprintf(b, sizeof(b), "%g", v);
+        return b;
+    }
+
+public:
+    Runner(std::string program, Options opt) : program_(std::move(program)), opt_(std::move(opt)) {
+        system_ = SystemState::Probe();
+        system_.Warn();
+    }
+
+    ~Runner() {
+        Write();
+        if (opt_.pause) {
+            printf("%s", "Press enter to exit.\n");
+            getchar();
+        }
+    }
+
+    const Options& options() const { return opt_; }
+
+    // thread safe, samples are appended if the name exists
+    const Result& Add(const std::string& name, const std::string& unit, const std::vector<double>& samples, bool print = true) {
+        std::lock_guard<std::mutex> lg(lock_);
+        auto it = index_.find(name);
+        if (it == index_.end()) {
+            it = index_.emplace(name, results_.size()).first;
+            results_.push_back(Result{ name, unit, {}, {} });
+        }
+        auto& r = results_[it->second];
+        r.samples.insert(r.samples.end(), samples.begin(), samples.end());
+        r.stats = Summarize(r.samples);
+        if (print)
+            Print(r);
+        return r;
+    }
+
+    template<class Trial>
+    const Result& Run(const std::string& name, const std::string& unit, Trial&& trial) {
+        return Add(name, unit, Collect(opt_, trial));
+    }
+
+    static void Print(const Result& r) {
+        auto& s = r.stats;
+        printf("%s: %g %s (median of %zu, p5 %g, p95 %g, 95%% ci %g .. %g)\n",
+            r.name.c_str(), s.median, r.unit.c_str(), s.count, s.p5, s.p95, s.ci_low, s.ci_high);
+    }
+
+    void Print(const std::string& name) {
+        std::lock_guard<std::mutex> lg(lock_);
+        auto it = index_.find(name);
+        if (it != index_.end())
+            Print(results_[it->second]);
+    }
+
+    void Write() {
+        std::lock_guard<std::mutex> lg(lock_);
+        if (!opt_.json_path.empty()) {
+            std::ofstream f(opt_.json_path);
+            f << "{\n  \"program\": \"" << Escape(program_) << "\",\n";
+            f << "  \"system\": { \"governor\": \"" << Escape(system_.governor) << "\", \"turbo\": " << system_.turbo << " },\n";
+            f << "  \"results\": [";
+            for(size_t i = 0; i < results_.size(); ++i) {
+                auto& r = results_[i];
+                auto& s = r.stats;
+                f << (i ? ",\n" : "\n");
+                f << "    { \"name\": \"" << Escape(r.name) << "\", \"unit\": \"" << Escape(r.unit) << "\""
+                  << ", \"count\": " << s.count << ", \"median\": " << Number(s.median)
+                  << ", \"p5\": " << Number(s.p5) << ", \"p95\": " << Number(s.p95)
+                  << ", \"mean\": " << Number(s.mean) << ", \"stddev\": " << Number(s.stddev)
+                  << ", \"ci_low\": " << Number(s.ci_low) << ", \"ci_high\": " << Number(s.ci_high)
+                  << ", \"samples\": [";
+                for(size_t j = 0; j < r.samples.size(); ++j)
+                    f << (j ? ", " : "") << Number(r.samples[j]);
+                f << "] }";
+            }
+            f << "\n  ]\n}\n";
+        }
+        if (!opt_.csv_path.empty()) {
+            std::ofstream f(opt_.csv_path);
+            f << "program,name,unit,count,median,p5,p95,mean,stddev,ci_low,ci_high,governor,turbo\n";
+            for(auto& r: results_) {
+                auto& s = r.stats;
+                f << '"' << program_ << "\",\"" << r.name << "\"," << r.unit << ',' << s.count << ','
+                  << s.median << ',' << s.p5 << ',' << s.p95 << ',' << s.mean << ',' << s.stddev << ','
+                  << s.ci_low << ',' << s.ci_high << ',' << system_.governor << ',' << system_.turbo << '\n';
+            }
+        }
+    }
+};
+
+} // namespace bench
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <string>
+#include <fstream>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+// cache and memory sizes the tests tune their tiles / thresholds with
+//
+//   auto prof = MachineProfile::Load();
+//   do_test("L1 cached", std::bind(cache_rotate, (int)prof.l1d.size));
+//
+// Load() reads $MACHINE_PROFILE or ./machine_profile.txt (written by `mem-timing cache`),
+// falls back to cpuid, then to the values the tests used to hardcode (i9-13900HX).
+// the file is key=value lines, '#' starts a comment, unknown keys are ignored.
+struct MachineProfile {
+    struct Cache {
+        int64_t size = 0;       // bytes
+        int ways = 0;
+        double latency_ns = 0;  // measured load-to-use, 0 if unknown
+    };
+
+    int64_t line_size = 64;
+    Cache l1d{ 32 * 1024, 8 };
+    Cache l2{ 2 * 1024 * 1024, 16 };
+    Cache l3{ 36 * 1024 * 1024, 12 };
+    int64_t dram_rowsize = 64 * 1024;
+    int64_t dram_channels = 4;
+    std::string source = "default";
+
+    const Cache& LastLevel() const {
+        return l3.size ? l3 : l2;
+    }
+
+    // deterministic cache parameters, leaf 4 on intel, 0x8000001d on amd
+    static bool FromCpuid(MachineProfile& p) {
+        auto cpuid = [](unsigned leaf, unsigned sub, unsigned r[4]) {
+#ifdef _MSC_VER
+            __cpuidex((int*)r, (int)leaf, (int)sub);
+#else
+            __cpuid_count(leaf, sub, r[0], r[1], r[2], r[3]);
+#endif
+        };
+        unsigned r[4];
+        cpuid(0, 0, r);
+        unsigned leaf = r[0] >= 4 ? 4 : 0;
+        cpuid(0x80000000, 0, r);
+        unsigned ext_max = r[0];
+        cpuid(leaf, 0, r);
+        if (leaf == 0 || (r[0] & 0x1F) == 0) {
+            if (ext_max < 0x8000001D)
+                return false;
+            leaf = 0x8000001D;
+        }
+        bool found = false;
+        MachineProfile q = p;
+        q.l3 = Cache{}; // not every cpu has one
+        for(unsigned sub = 0; sub < 16; ++sub) {
+            cpuid(leaf, sub, r);
+            unsigned type = r[0] & 0x1F; // 1 data, 2 instruction, 3 unified
+            if (type == 0)
+                break;
+            if (type == 2)
+                continue;
+            unsigned level = (r[0] >> 5) & 7;
+            Cache c;
+            c.ways = (int)((r[1] >> 22) + 1);
+            int64_t partitions = ((r[1] >> 12) & 0x3FF) + 1;
+            int64_t line = (r[1] & 0xFFF) + 1;
+            c.size = c.ways * partitions * line * ((int64_t)r[2] + 1);
+            if (level == 1) {
+                q.l1d = c;
+                q.line_size = line;
+            } else if (level == 2) {
+                q.l2 = c;
+            } else if (level == 3) {
+                q.l3 = c;
+            }
+            found = true;
+        }
+        if (found) {
+            p = q;
+            p.source = "cpuid";
+        }
+        return found;
+    }
+
+    bool LoadFile(const std::string& path) {
+        std::ifstream f(path);
+        if (!f)
+            return false;
+        std::string line;
+        while(std::getline(f, line)) {
+            auto eq = line.find('=');
+            if (line.empty() || line[0] == '#' || eq == std::string::npos)
+                continue;
+            std::string key = line.substr(0, eq);
+            const char* v = line.c_str() + eq + 1;
+            auto cache = [&](const char* prefix, Cache& c) {
+                std::string pre = prefix;
+                if (key == pre + "_size")
+                    c.size = atoll(v);
+                else if (key == pre + "_ways")
+                    c.ways = atoi(v);
+                else if (key == pre + "_latency_ns")
+                    c.latency_ns = atof(v);
+            };
+            if (key == "line_size")
+                line_size = atoll(v);
+            else if (key == "dram_rowsize")
+                dram_rowsize = atoll(v);
+            else if (key == "dram_channels")
+                dram_channels = atoll(v);
+            cache("l1d", l1d);
+            cache("l2", l2);
+            cache("l3", l3);
+        }
+        source = path;
+        return true;
+    }
+
+    bool Save(const std::string& path, const char* comment = nullptr) const {
+        FILE* f = fopen(path.c_str(), "w");
+        if (!f)
+            return false;
+        if (comment)
+            fprintf(f, "# %s\n", comment);
+        fprintf(f, "line_size=%lld\n", (long long)line_size);
+        auto cache = [&](const char* prefix, const Cache& c) {
+            fprintf(f, "%s_size=%lld\n%s_ways=%d\n%s_latency_ns=%.2f\n", prefix, (long long)c.size, prefix, c.ways, prefix, c.latency_ns);
+        };
+        cache("l1d", l1d);
+        cache("l2", l2);
+        cache("l3", l3);
+        fprintf(f, "dram_rowsize=%lld\n", (long long)dram_rowsize);
+        fprintf(f, "dram_channels=%lld\n", (long long)dram_channels);
+        fclose(f);
+        return true;
+    }
+
+    static MachineProfile Load() {
+        MachineProfile p;
+        const char* env = getenv("MACHINE_PROFILE");
+        if (p.LoadFile(env ? env : "machine_profile.txt"))
+            return p;
+        FromCpuid(p);
+        return p;
+    }
+
+    void Print() const {
+        printf("machine profile (%s): line %lld, L1d %lld KB %d-way, L2 %lld KB %d-way, L3 %lld KB %d-way\n",
+            source.c_str(), (long long)line_size, (long long)l1d.size / 1024, l1d.ways,
+            (long long)l2.size / 1024, l2.ways, (long long)l3.size / 1024, l3.ways);
+    }
+};
@@ -0,0 +1,203 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdlib>
+#include <cstdio>
+#include <vector>
+#include <bitset>
+#include <unordered_map>
+#include <algorithm>
+
+#include "machine_profile.h"
+
+// visit order of blocks (image tiles, matrix panels, ...) for dram row buffer hits
+//
+//   RowBlocks blocks;
+//   for(each tile) { blocks.Begin(); for(each tile line) blocks.Add(ptr, bytes); }
+//   auto loc = RowLocality::FromProfile(MachineProfile::Load());
+//   auto order = loc.Optimize(blocks);        // tile indices
+//   auto hit = loc.Score(blocks, order).HitRate();
+//
+// the model keeps one open row per bank: a span is cut at row boundaries, the first line of
+// every piece is a hit if its bank still has that row open, the rest of the piece always is.
+// rows are addr / rowsize (mem-timing's row span, all channels), the bank is (row % banks) or
+// the xor functions printed by `mem-timing addrmap`. virtual addresses stand in for physical
+// ones, right below the huge page size.
+
+class RowBlocks {
+public:
+    struct Span {
+        uint64_t addr;
+        uint64_t bytes;
+    };
+
+    void Begin() { first_.push_back(spans_.size()); }
+    void Add(const void* p, uint64_t bytes) { spans_.push_back({ (uint64_t)(uintptr_t)p, bytes }); }
+
+    size_t size() const { return first_.size(); }
+    const Span* begin(size_t block) const { return spans_.data() + first_[block]; }
+    const Span* end(size_t block) const { return spans_.data() + (block + 1 < first_.size() ? first_[block + 1] : spans_.size()); }
+
+private:
+    std::vector<Span> spans_;
+    std::vector<size_t> first_;
+};
+
+class RowLocality {
+public:
+    struct Stats {
+        int64_t hits = 0;
+        int64_t misses = 0;   // row opened: empty bank or conflict
+        double HitRate() const { return hits + misses ? (double)hits / (hits + misses) : 0; }
+    };
+
+    RowLocality(int64_t rowsize, int banks, std::vector<uint64_t> bank_functions = {})
+        : rowsize_(std::max<int64_t>(rowsize, 64)), banks_(std::max(banks, 1)), functions_(std::move(bank_functions)) {
+        if (!functions_.empty())
+            banks_ = 1 << functions_.size();
+    }
+
+    // 16 banks per channel (4 groups x 4 on ddr4 / ddr5 x8), modulo mapping
+    static RowLocality FromProfile(const MachineProfile& p) {
+        return RowLocality(p.dram_rowsize, (int)p.dram_channels * 16);
+    }
+
+    // "13 ^ 17, 14 ^ 18" as printed by `mem-timing addrmap`, empty if a bit is out of 0..63
+    static std::vector<uint64_t> ParseBankFunctions(const char* s) {
+        std::vector<uint64_t> f(1, 0);
+        for(const char* p = s; *p; ++p) {
+            if (*p >= '0' && *p <= '9') {
+                long bit = strtol(p, (char**)&p, 10);
+                if (bit > 63) {
+                    printf("bank function bit %ld out of range, address bits are 0..63.\n", bit);
+                    return {};
+                }
+                f.back() |= 1ull << bit;
+                --p;
+            } else if (*p == ',') {
+                f.push_back(0);
+            }
+        }
+        return f;
+    }
+
+    int64_t rowsize() const { return rowsize_; }
+    int banks() const { return banks_; }
+
+    int64_t Row(uint64_t addr) const { return (int64_t)(addr / (uint64_t)rowsize_); }
+
+    int Bank(uint64_t addr) const {
+        if (functions_.empty())
+            return (int)(Row(addr) % banks_);
+        int b = 0;
+        for(size_t i = 0; i < functions_.size(); ++i)
+            b |= (int)(std::bitset<64>(addr & functions_[i]).count() & 1) << i;
+        return b;
+    }
+
+    // the blocks visited in `order` from all banks closed
+    Stats Score(const RowBlocks& blocks, const std::vector<int>& order) const {
+        std::vector<int64_t> open((size_t)banks_, -1);
+        Stats s;
+        for(int b: order)
+            Visit(blocks, (size_t)b, open, s);
+        return s;
+    }
+
+    // greedy: next is the unvisited block with the best hit rate against the rows open now,
+    // among the blocks that touch one of them; ties and no candidates fall back to `start` order
+    std::vector<int> Optimize(const RowBlocks& blocks, std::vector<int> start = {}) const {
+        const size_t n = blocks.size();
+        if (start.empty()) {
+            for(size_t i = 0; i < n; ++i)
+                start.push_back((int)i);
+        }
+        std::vector<size_t> rank(n);
+        for(size_t i = 0; i < n; ++i)
+            rank[(size_t)start[i]] = i;
+
+        // row -> blocks touching it
+        std::unordered_map<int64_t, std::vector<int>> by_row;
+        for(size_t b = 0; b < n; ++b) {
+            int64_t last = -1;
+            ForPieces(blocks, b, [&](uint64_t addr, uint64_t) {
+                int64_t r = Row(addr);
+                if (r != last && (by_row[r].empty() || by_row[r].back() != (int)b))
+                    by_row[r].push_back((int)b);
+                last = r;
+            });
+        }
+
+        std::vector<int64_t> open((size_t)banks_, -1);
+        std::vector<bool> done(n);
+        std::vector<size_t> tried(n, SIZE_MAX); // a block touching several open rows is scored once
+        std::vector<int> order;
+        size_t next_start = 0;
+        Stats s;
+        while(order.size() < n) {
+            int best = -1;
+            double best_rate = -1;
+            for(int64_t r: open) {
+                auto it = r < 0 ? by_row.end() : by_row.find(r);
+                if (it == by_row.end())
+                    continue;
+                for(int b: it->second) {
+                    if (done[(size_t)b] || tried[(size_t)b] == order.size())
+                        continue;
+                    tried[(size_t)b] = order.size();
+                    std::vector<int64_t> trial = open;
+                    Stats t;
+                    Visit(blocks, (size_t)b, trial, t);
+                    double rate = t.HitRate();
+                    if (rate > best_rate || (rate == best_rate && rank[(size_t)b] < rank[(size_t)best])) {
+                        best = b;
+                        best_rate = rate;
+                    }
+                }
+            }
+            if (best < 0) {
+                while(done[(size_t)start[next_start]])
+                    ++next_start;
+                best = start[next_start];
+            }
+            done[(size_t)best] = true;
+            order.push_back(best);
+            Visit(blocks, (size_t)best, open, s);
+        }
+        return order;
+    }
+
+private:
+    int64_t rowsize_;
+    int banks_;
+    std::vector<uint64_t> functions_;
+
+    // the spans of a block cut at row boundaries: f(addr, lines)
+    template<class F>
+    void ForPieces(const RowBlocks& blocks, size_t b, F f) const {
+        for(auto s = blocks.begin(b); s != blocks.end(b); ++s) {
+            uint64_t a = s->addr, end = s->addr + s->bytes;
+            while(a < end) {
+                uint64_t row_end = (a / (uint64_t)rowsize_ + 1) * (uint64_t)rowsize_;
+                uint64_t e = std::min(end, row_end);
+                f(a, (e - 1) / 64 - a / 64 + 1);
+                a = e;
+            }
+        }
+    }
+
+    void Visit(const RowBlocks& blocks, size_t b, std::vector<int64_t>& open, Stats& s) const {
+        ForPieces(blocks, b, [&](uint64_t addr, uint64_t lines) {
+            int64_t& o = open[(size_t)Bank(addr)];
+            int64_t r = Row(addr);
+            if (o == r) {
+                s.hits += (int64_t)lines;
+            } else {
+                s.misses += 1;
+                s.hits += (int64_t)lines - 1;
+                o = r;
+            }
+        });
+    }
+};
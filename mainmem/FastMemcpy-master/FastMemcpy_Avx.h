@@ -362,6 +362,13 @@ static INLINE void *memcpy_tiny(void *dst, const void *src, size_t size) {
 }
 
 
+//---------------------------------------------------------------------
+// L3-cache size, above it the copy uses streaming stores.
+// the test programs set it from the machine profile at startup.
+//---------------------------------------------------------------------
+static size_t memcpy_fast_cachesize = 36 * 1048576;
+
+
 //---------------------------------------------------------------------
 // main routine
 //---------------------------------------------------------------------
@@ -369,8 +376,7 @@ static void* memcpy_fast(void *destination, const void *source, size_t size)
 {
 	unsigned char *dst = (unsigned char*)destination;
 	const unsigned char *src = (const unsigned char*)source;
-	// static size_t cachesize = 0x200000; // L3-cache size
-	static size_t cachesize = 36 * 1048576; // L3-cache size
+	size_t cachesize = memcpy_fast_cachesize;
 	size_t padding;
 
 	// small memory copy
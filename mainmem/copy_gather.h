@@ -0,0 +1,143 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include <FastMemcpy_Avx.h>
+
+#ifdef _WIN32
+struct iovec {
+    void* iov_base;
+    size_t iov_len;
+};
+#else
+#include <sys/uio.h>
+#endif
+
+// batched copy of many small fragments
+//
+// fragments are bucketed by size class first (counting sort, output order is kept through the
+// precomputed offsets), then every bucket runs one branch-free kernel from FastMemcpy_Avx.h
+// and prefetches the sources a few fragments ahead. vzeroupper is paid once per batch.
+
+namespace copy_gather_detail {
+
+// <= 16, <= 32, <= 64, <= 128, <= 256, larger
+constexpr int class_count = 6;
+constexpr size_t prefetch_distance = 8; // fragments ahead
+
+inline int size_class(size_t len) {
+    return (len > 16) + (len > 32) + (len > 64) + (len > 128) + (len > 256);
+}
+
+struct Item {
+    uint8_t* dst;
+    const uint8_t* src;
+    size_t len;
+};
+
+// head and tail copies overlap, the whole fragment is covered without a size switch
+template<int C>
+inline void copy_class(uint8_t* d, const uint8_t* s, size_t n) {
+    if constexpr (C == 0) {
+        if (n >= 8) {
+            uint64_t a, b;
+            memcpy(&a, s, 8);
+            memcpy(&b, s + n - 8, 8);
+            memcpy(d, &a, 8);
+            memcpy(d + n - 8, &b, 8);
+        } else if (n >= 4) {
+            uint32_t a, b;
+            memcpy(&a, s, 4);
+            memcpy(&b, s + n - 4, 4);
+            memcpy(d, &a, 4);
+            memcpy(d + n - 4, &b, 4);
+        } else {
+            for(size_t i = 0; i < n; ++i)
+                d[i] = s[i];
+        }
+    } else if constexpr (C == 1) {
+        memcpy_avx_16(d, s);
+        memcpy_avx_16(d + n - 16, s + n - 16);
+    } else if constexpr (C == 2) {
+        memcpy_avx_32(d, s);
+        memcpy_avx_32(d + n - 32, s + n - 32);
+    } else if constexpr (C == 3) {
+        memcpy_avx_64(d, s);
+        memcpy_avx_64(d + n - 64, s + n - 64);
+    } else if constexpr (C == 4) {
+        memcpy_avx_128(d, s);
+        memcpy_avx_128(d + n - 128, s + n - 128);
+    } else {
+        memcpy(d, s, n); // libc is better than memcpy_fast at this size
+    }
+}
+
+template<int C>
+inline void copy_bucket(const Item* items, size_t count) {
+    for(size_t i = 0; i < count; ++i) {
+        if (i + prefetch_distance < count)
+            _mm_prefetch((const char*)items[i + prefetch_distance].src, _MM_HINT_T0);
+        copy_class<C>(items[i].dst, items[i].src, items[i].len);
+    }
+}
+
+// items is grouped by class on return, begin[c] .. begin[c + 1] is class c
+template<class MakeItem>
+inline void bucket(const iovec* iov, size_t n, MakeItem&& make, std::vector<Item>& items, size_t (&begin)[class_count + 1]) {
+    size_t counts[class_count] = {};
+    for(size_t i = 0; i < n; ++i)
+        ++counts[size_class(iov[i].iov_len)];
+    begin[0] = 0;
+    for(int c = 0; c < class_count; ++c)
+        begin[c + 1] = begin[c] + counts[c];
+    size_t pos[class_count];
+    std::copy(begin, begin + class_count, pos);
+    items.resize(n);
+    for(size_t i = 0; i < n; ++i)
+        items[pos[size_class(iov[i].iov_len)]++] = make(i);
+}
+
+inline void run(const std::vector<Item>& items, const size_t (&begin)[class_count + 1]) {
+    copy_bucket<0>(items.data() + begin[0], begin[1] - begin[0]);
+    copy_bucket<1>(items.data() + begin[1], begin[2] - begin[1]);
+    copy_bucket<2>(items.data() + begin[2], begin[3] - begin[2]);
+    copy_bucket<3>(items.data() + begin[3], begin[4] - begin[3]);
+    copy_bucket<4>(items.data() + begin[4], begin[5] - begin[4]);
+    copy_bucket<5>(items.data() + begin[5], begin[6] - begin[5]);
+    _mm256_zeroupper();
+}
+
+} // namespace copy_gather_detail
+
+// concatenate iov[0..n) into dst, returns bytes written
+inline size_t copy_gather(void* dst, const iovec* iov, size_t n) {
+    using namespace copy_gather_detail;
+    thread_local std::vector<Item> items;
+    size_t begin[class_count + 1];
+    size_t off = 0;
+    bucket(iov, n, [&](size_t i) {
+        Item it{ (uint8_t*)dst + off, (const uint8_t*)iov[i].iov_base, iov[i].iov_len };
+        off += iov[i].iov_len;
+        return it;
+    }, items, begin);
+    run(items, begin);
+    return off;
+}
+
+// split contiguous src over iov[0..n), returns bytes read
+inline size_t copy_scatter(const iovec* iov, size_t n, const void* src) {
+    using namespace copy_gather_detail;
+    thread_local std::vector<Item> items;
+    size_t begin[class_count + 1];
+    size_t off = 0;
+    bucket(iov, n, [&](size_t i) {
+        Item it{ (uint8_t*)iov[i].iov_base, (const uint8_t*)src + off, iov[i].iov_len };
+        off += iov[i].iov_len;
+        return it;
+    }, items, begin);
+    run(items, begin);
+    return off;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#define SIMDPP_ARCH_X86_AVX2
+#include "simdpp/simd.h"
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <FastMemcpy_Avx.h>
+
+#include "machine_profile.h"
+
+// memcpy_fast switches to streaming stores above this machine's last level cache, not the i9's
+inline void ApplyMachineProfile(const MachineProfile& prof) {
+    memcpy_fast_cachesize = (size_t)prof.LastLevel().size;
+}
+
+// copy implementations under test, each one is IMP::cpy(dst, src, size)
+
+struct STD {
+    static void cpy(void* dst, const void* src, intptr_t size) {
+        std::memcpy(dst, src, size);
+    }
+};
+
+struct ALG {
+    static void cpy(void* dst, const void* src, intptr_t size) {
+        std::copy_n((const char*)src, size, (char*)dst);
+    }
+};
+
+struct SIMD {
+    static void cpy(void* dst, const void* src, intptr_t size) {
+        register simdpp::int64x4 tmp;
+        for(int i = 0; i < size; i += 32) {
+            tmp = simdpp::load((const char*)src + i);
+            simdpp::prefetch_read((const char*)src + i + 512);
+            simdpp::stream((char*)dst + i, tmp);
+        }
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+};
+
+struct FastMemcpy {
+    static void cpy(void* dst, const void* src, intptr_t size) {
+        memcpy_fast(dst, src, size);
+    }
+};
+
+struct TmpTest {
+    static void cpy(void* dst, const void* src, intptr_t size) {
+        auto ps = (const uint8_t*) src;
+        auto pd = (uint8_t*) dst;
+
+        int us = 0;
+        // 一个内存行一个内存行处理
+        for(int off = 0; off < size; off += 65536) {
+            // 先cache来源的内存行
+            for(int cl = 0; cl < 65536; cl += 64)
+                us += ps[off + cl];
+            // 复制
+            memcpy(pd + off, ps + off, 65536);
+        }
+    }
+};
@@ -0,0 +1,323 @@
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <functional>
+
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define HAVE_IO_URING 1
+#endif
+
+#include "copy_impl.h"
+
+const size_t size = 256 * 1024 * 1024; // 256 MB, one "recording"
+const size_t chunk = 4 * 1024 * 1024;  // one frame-ish write
+const size_t loop = 5;
+
+// wall time and cpu time (user + sys) of one run
+struct Cost {
+    double wall_s = 0;
+    double cpu_s = 0;
+};
+
+static double cpu_seconds() {
+    rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 + ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+}
+
+// returns false if the path is not supported on the target filesystem
+using WriteProc = std::function<bool(const std::string& path, const void* src, bool sync)>;
+
+template<class IMP>
+static bool MmapWrite(const std::string& path, const void* src, bool sync) {
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return false;
+    if (ftruncate(fd, size) != 0) {
+        close(fd);
+        return false;
+    }
+    void* dst = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (dst == MAP_FAILED) {
+        close(fd);
+        return false;
+    }
+    IMP::cpy(dst, src, size);
+    if (sync)
+        msync(dst, size, MS_SYNC);
+    munmap(dst, size);
+    close(fd);
+    return true;
+}
+
+static bool Write(const std::string& path, const void* src, bool sync) {
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return false;
+    for(size_t off = 0; off < size; off += chunk) {
+        if (write(fd, (const char*)src + off, chunk) != (ssize_t)chunk) {
+            close(fd);
+            return false;
+        }
+    }
+    if (sync)
+        fdatasync(fd);
+    close(fd);
+    return true;
+}
+
+static bool Pwritev(const std::string& path, const void* src, bool sync) {
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return false;
+    // a batch of frames per syscall
+    const size_t batch = 16;
+    std::vector<iovec> iov(batch);
+    for(size_t off = 0; off < size; off += chunk * batch) {
+        for(size_t i = 0; i < batch; ++i) {
+            iov[i].iov_base = (char*)src + off + i * chunk;
+            iov[i].iov_len = chunk;
+        }
+        if (pwritev(fd, iov.data(), batch, off) != (ssize_t)(chunk * batch)) {
+            close(fd);
+            return false;
+        }
+    }
+    if (sync)
+        fdatasync(fd);
+    close(fd);
+    return true;
+}
+
+// src must be aligned to the logical block size, it is page aligned here
+static bool DirectWrite(const std::string& path, const void* src, bool sync) {
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+    if (fd < 0)
+        return false; // tmpfs says EINVAL
+    for(size_t off = 0; off < size; off += chunk) {
+        if (write(fd, (const char*)src + off, chunk) != (ssize_t)chunk) {
+            close(fd);
+            return false;
+        }
+    }
+    if (sync)
+        fdatasync(fd);
+    close(fd);
+    return true;
+}
+
+#ifdef HAVE_IO_URING
+// bare io_uring through syscalls, no liburing dependency
+class IoUring {
+    int fd_ = -1;
+    unsigned entries_ = 0;
+    void* sq_ptr_ = MAP_FAILED;
+    void* cq_ptr_ = MAP_FAILED;
+    size_t sq_size_ = 0, cq_size_ = 0;
+    io_uring_sqe* sqes_ = (io_uring_sqe*)MAP_FAILED;
+    unsigned *sq_tail_, *sq_mask_, *sq_array_;
+    unsigned *cq_head_, *cq_tail_, *cq_mask_;
+    io_uring_cqe* cqes_;
+
+public:
+    explicit IoUring(unsigned entries) {
+        io_uring_params p{};
+        fd_ = (int)syscall(__NR_io_uring_setup, entries, &p);
+        if (fd_ < 0)
+            return;
+        entries_ = p.sq_entries;
+        sq_size_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        cq_size_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        sq_ptr_ = mmap(nullptr, sq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+        cq_ptr_ = mmap(nullptr, cq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+        sqes_ = (io_uring_sqe*)mmap(nullptr, p.sq_entries * sizeof(io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+        if (sq_ptr_ == MAP_FAILED || cq_ptr_ == MAP_FAILED || sqes_ == MAP_FAILED) {
+            close(fd_);
+            fd_ = -1;
+            return;
+        }
+        auto sq = (char*)sq_ptr_;
+        sq_tail_ = (unsigned*)(sq + p.sq_off.tail);
+        sq_mask_ = (unsigned*)(sq + p.sq_off.ring_mask);
+        sq_array_ = (unsigned*)(sq + p.sq_off.array);
+        auto cq = (char*)cq_ptr_;
+        cq_head_ = (unsigned*)(cq + p.cq_off.head);
+        cq_tail_ = (unsigned*)(cq + p.cq_off.tail);
+        cq_mask_ = (unsigned*)(cq + p.cq_off.ring_mask);
+        cqes_ = (io_uring_cqe*)(cq + p.cq_off.cqes);
+    }
+
+    ~IoUring() {
+        if (sqes_ != MAP_FAILED)
+            munmap(sqes_, entries_ * sizeof(io_uring_sqe));
+        if (cq_ptr_ != MAP_FAILED)
+            munmap(cq_ptr_, cq_size_);
+        if (sq_ptr_ != MAP_FAILED)
+            munmap(sq_ptr_, sq_size_);
+        if (fd_ >= 0)
+            close(fd_);
+    }
+
+    bool ok() const { return fd_ >= 0; }
+    unsigned entries() const { return entries_; }
+
+    void queue_writev(int fd, const iovec* iov, uint64_t off) {
+        unsigned tail = *sq_tail_;
+        unsigned idx = tail & *sq_mask_;
+        io_uring_sqe* sqe = &sqes_[idx];
+        *sqe = io_uring_sqe{};
+        sqe->opcode = IORING_OP_WRITEV;
+        sqe->fd = fd;
+        sqe->addr = (uint64_t)iov;
+        sqe->len = 1;
+        sqe->off = off;
+        sqe->user_data = iov->iov_len; // a short write completes with less
+        sq_array_[idx] = idx;
+        __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+    }
+
+    // submit what is queued, wait for at least `wait` completions and reap all of them
+    // returns the number reaped, -1 on any failed or short write
+    int submit_and_reap(unsigned submit, unsigned wait) {
+        if (syscall(__NR_io_uring_enter, fd_, submit, wait, IORING_ENTER_GETEVENTS, nullptr, 0) < 0)
+            return -1;
+        int reaped = 0;
+        bool ok = true;
+        unsigned head = *cq_head_;
+        unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+        for(; head != tail; ++head, ++reaped) {
+            const io_uring_cqe& cqe = cqes_[head & *cq_mask_];
+            if (cqe.res < 0 || (uint64_t)cqe.res != cqe.user_data)
+                ok = false;
+        }
+        __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+        return ok ? reaped : -1;
+    }
+};
+
+static bool IoUringWrite(const std::string& path, const void* src, bool sync) {
+    IoUring ring(32);
+    if (!ring.ok())
+        return false;
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return false;
+    const size_t count = size / chunk;
+    std::vector<iovec> iov(count);
+    size_t queued = 0, inflight = 0;
+    bool ok = true;
+    while(ok && (queued < count || inflight > 0)) {
+        unsigned submit = 0;
+        while(queued < count && inflight < ring.entries()) {
+            iov[queued].iov_base = (char*)src + queued * chunk;
+            iov[queued].iov_len = chunk;
+            ring.queue_writev(fd, &iov[queued], queued * chunk);
+            ++queued;
+            ++inflight;
+            ++submit;
+        }
+        // keep the queue half full while waiting
+        unsigned wait = queued < count ? std::max(1u, ring.entries() / 2) : (unsigned)inflight;
+        if (wait > inflight)
+            wait = (unsigned)inflight;
+        int reaped = ring.submit_and_reap(submit, wait);
+        ok = reaped >= 0;
+        if (ok)
+            inflight -= reaped;
+    }
+    if (ok && sync)
+        fdatasync(fd);
+    close(fd);
+    return ok;
+}
+#endif
+
+int main(int argc, char** argv) {
+    using namespace std::chrono;
+
+    // e.g. filewritetest /dev/shm /mnt/ext4loop
+    std::vector<std::string> dirs;
+    for(int i = 1; i < argc; ++i)
+        dirs.emplace_back(argv[i]);
+    if (dirs.empty()) {
+        dirs.emplace_back("/dev/shm");
+        dirs.emplace_back(".");
+    }
+    ApplyMachineProfile(MachineProfile::Load());
+
+    void* src = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (src == MAP_FAILED) {
+        printf("%s", "cannot allocate source buffer\n");
+        return 1;
+    }
+    // incompressible and different in every page, so no compression, dedup or zero page shortcut
+    uint64_t x = 0x9E3779B97F4A7C15ull;
+    for(size_t i = 0; i < size / 8; ++i) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        ((uint64_t*)src)[i] = x;
+    }
+
+    std::vector<std::pair<const char*, WriteProc>> procs;
+    procs.emplace_back("mmap std::memcpy", MmapWrite<STD>);
+    procs.emplace_back("mmap simdpp", MmapWrite<SIMD>);
+    procs.emplace_back("mmap FastMemcpy", MmapWrite<FastMemcpy>);
+    procs.emplace_back("mmap TmpTest", MmapWrite<TmpTest>);
+    procs.emplace_back("write", Write);
+    procs.emplace_back("pwritev", Pwritev);
+    procs.emplace_back("O_DIRECT", DirectWrite);
+#ifdef HAVE_IO_URING
+    procs.emplace_back("io_uring", IoUringWrite);
+#endif
+
+    printf("file: %zu MB, chunk: %zu KB\n", size / 1048576, chunk / 1024);
+
+    for(auto& dir: dirs) {
+        std::string path = dir + "/filewritetest.tmp";
+        printf("\n%s\n", dir.c_str());
+        for(auto& [name, proc]: procs) {
+            for(bool sync: { false, true }) {
+                Cost total;
+                bool ok = true;
+                int err = 0;
+                for(size_t i = 0; i < loop && ok; ++i) {
+                    auto cpu_begin = cpu_seconds();
+                    auto begin = steady_clock::now();
+                    ok = proc(path, src, sync);
+                    if (!ok)
+                        err = errno;
+                    total.wall_s += duration_cast<nanoseconds>(steady_clock::now() - begin).count() / 1e9;
+                    total.cpu_s += cpu_seconds() - cpu_begin;
+                    unlink(path.c_str()); // don't count the truncate of last run
+                }
+                if (!ok) {
+                    printf("%-18s %-6s: not supported (%s)\n", name, sync ? "sync" : "nosync", strerror(err));
+                    continue;
+                }
+                double gib = size * loop / 1073741824.0;
+                printf("%-18s %-6s: %10g MB/S, cpu %8.3f s/GiB\n", name, sync ? "sync" : "nosync",
+                    size * loop / 1048576.0 / total.wall_s, total.cpu_s / gib);
+            }
+        }
+    }
+
+    munmap(src, size);
+    printf("%s", "End.\n");
+
+    return 0;
+}
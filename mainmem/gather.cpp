@@ -0,0 +1,153 @@
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <functional>
+#include <algorithm>
+
+#include "copy_gather.h"
+
+const size_t batch_bytes = 64 * 1024;       // one output packet train
+const size_t loop = 2000;
+
+struct Distribution {
+    const char* name;
+    std::function<size_t(std::mt19937&)> draw;
+};
+
+// build `loop` batches of fragments scattered over the pool
+static std::vector<std::vector<iovec>> MakeBatches(uint8_t* pool, size_t pool_size, const Distribution& dist) {
+    std::mt19937 mt(1234);
+    std::vector<std::vector<iovec>> batches(loop);
+    for(auto& b: batches) {
+        size_t total = 0;
+        while(total < batch_bytes) {
+            size_t len = std::min(dist.draw(mt), batch_bytes - total);
+            size_t off = std::uniform_int_distribution<size_t>(0, pool_size - len)(mt);
+            b.push_back(iovec{ pool + off, len });
+            total += len;
+        }
+    }
+    return batches;
+}
+
+int main(int, char**) {
+    using namespace std::chrono;
+
+    // fragments are picked from a cache resident pool and from a DRAM sized pool
+    std::vector<size_t> pool_sizes = { 512 * 1024, 64 * 1024 * 1024 };
+    std::vector<uint8_t> pool(pool_sizes.back());
+    std::mt19937 fill(42);
+    for(auto& v: pool)
+        v = (uint8_t)fill();
+    std::vector<uint8_t> out(batch_bytes), chk(batch_bytes);
+    std::vector<uint8_t> scatter_chk(batch_bytes * 8), scatter_out(batch_bytes * 8); // 1 byte fragments + 7 byte gaps
+
+    std::vector<Distribution> dists = {
+        // rtp header + payload
+        { "rtp 12 + 1200", [](std::mt19937& mt) { return mt() % 2 ? size_t(12) : size_t(1200); } },
+        { "uniform 1-256", [](std::mt19937& mt) { return size_t(1 + mt() % 256); } },
+        { "lognormal ~48", [](std::mt19937& mt) {
+            return std::clamp<size_t>((size_t)std::lognormal_distribution<double>(3.8, 0.9)(mt), 1, 4096);
+        } },
+        { "nal 4 + 1-1500", [](std::mt19937& mt) { return mt() % 2 ? size_t(4) : size_t(1 + mt() % 1500); } },
+    };
+
+    auto naive_memcpy = [&](const std::vector<iovec>& iov) {
+        size_t off = 0;
+        for(auto& v: iov) {
+            memcpy(out.data() + off, v.iov_base, v.iov_len);
+            off += v.iov_len;
+        }
+    };
+    auto naive_fast = [&](const std::vector<iovec>& iov) {
+        size_t off = 0;
+        for(auto& v: iov) {
+            memcpy_fast(out.data() + off, v.iov_base, v.iov_len);
+            off += v.iov_len;
+        }
+    };
+    auto gather = [&](const std::vector<iovec>& iov) {
+        copy_gather(out.data(), iov.data(), iov.size());
+    };
+    auto scatter_naive = [&](const std::vector<iovec>& iov) {
+        size_t off = 0;
+        for(auto& v: iov) {
+            memcpy(v.iov_base, out.data() + off, v.iov_len);
+            off += v.iov_len;
+        }
+    };
+    auto scatter = [&](const std::vector<iovec>& iov) {
+        copy_scatter(iov.data(), iov.size(), out.data());
+    };
+
+    for(auto pool_size: pool_sizes) {
+        for(auto& dist: dists) {
+            auto batches = MakeBatches(pool.data(), pool_size, dist);
+            size_t fragments = 0;
+            for(auto& b: batches)
+                fragments += b.size();
+
+            // check gather against the naive loop
+            bool ok = true;
+            for(size_t i = 0; i < 16 && ok; ++i) {
+                naive_memcpy(batches[i]);
+                memcpy(chk.data(), out.data(), batch_bytes);
+                memset(out.data(), 0, batch_bytes);
+                gather(batches[i]);
+                ok = memcmp(chk.data(), out.data(), batch_bytes) == 0;
+            }
+            if (!ok) {
+                printf("%s: incorrect copy_gather implementation.\n", dist.name);
+                continue;
+            }
+            // and scatter, to fragments laid out apart (the pool fragments may overlap)
+            for(size_t i = 0; i < 16 && ok; ++i) {
+                std::vector<iovec> a, b;
+                size_t off = 0;
+                for(auto& v: batches[i]) {
+                    a.push_back(iovec{ scatter_chk.data() + off, v.iov_len });
+                    b.push_back(iovec{ scatter_out.data() + off, v.iov_len });
+                    off += v.iov_len + 7; // the gaps must stay untouched
+                }
+                memset(scatter_chk.data(), 0, scatter_chk.size());
+                memset(scatter_out.data(), 0, scatter_out.size());
+                memcpy(out.data(), pool.data() + i * batch_bytes, batch_bytes);
+                scatter_naive(a);
+                scatter(b);
+                ok = memcmp(scatter_chk.data(), scatter_out.data(), scatter_out.size()) == 0;
+            }
+            if (!ok) {
+                printf("%s: incorrect copy_scatter implementation.\n", dist.name);
+                continue;
+            }
+
+            printf("%s, pool %zu KB: avg %g bytes per fragment\n", dist.name, pool_size / 1024, (double)batch_bytes * loop / fragments);
+            double base = 0;
+            auto run = [&](const char* name, std::function<void(const std::vector<iovec>&)> proc) {
+                for(auto& b: batches) // warm up
+                    proc(b);
+                auto begin = steady_clock::now();
+                for(auto& b: batches)
+                    proc(b);
+                double ns = (double)duration_cast<nanoseconds>(steady_clock::now() - begin).count();
+                if (base == 0)
+                    base = ns;
+                printf("    %-16s: %8.2f ns/fragment, %10g MB/S, x%.2f\n", name,
+                    ns / fragments, batch_bytes * loop / 1048576.0 / (ns / 1e9), base / ns);
+            };
+            run("memcpy loop", naive_memcpy);
+            run("memcpy_fast loop", naive_fast);
+            run("copy_gather", gather);
+            base = 0;
+            run("scatter loop", scatter_naive);
+            run("copy_scatter", scatter);
+        }
+    }
+
+    printf("%s", "End.\n");
+
+    return 0;
+}
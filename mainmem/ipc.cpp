@@ -0,0 +1,209 @@
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdint>
+#include <vector>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+
+#include "copy_impl.h"
+#include "shm_ring.h"
+
+const size_t ring_bytes = 16 * 1024 * 1024;
+const size_t total_bytes = 1024 * 1024 * 1024; // per test
+
+// consumer reads one word per cache line, so every mode ends with the payload visible to the consumer
+static uint64_t touch(const void* p, size_t len) {
+    uint64_t sum = 0;
+    for(size_t off = 0; off < len; off += 64)
+        sum += *(const volatile uint64_t*)((const uint8_t*)p + off);
+    return sum;
+}
+
+// producer runs in the child, the consumer is timed in the parent
+// (the parent may process_vm_readv its child with the default yama ptrace_scope)
+static double RunPair(std::function<void()> producer, std::function<void(pid_t)> consumer) {
+    using namespace std::chrono;
+    pid_t pid = fork();
+    if (pid == 0) {
+        producer();
+        _exit(0);
+    }
+    auto begin = steady_clock::now();
+    consumer(pid);
+    auto cost = steady_clock::now() - begin;
+    waitpid(pid, nullptr, 0);
+    return duration_cast<nanoseconds>(cost).count() / 1e9;
+}
+
+static void Report(const char* name, size_t len, size_t count, double seconds) {
+    printf("%-20s %8zu B: %12.0f msg/s, %10g MB/S\n", name, len,
+        count / seconds, len * count / 1048576.0 / seconds);
+}
+
+template<class IMP>
+static void RingCopyTest(const char* name, const void* payload, size_t len, size_t count, uint64_t* sink) {
+    auto ring = ShmRing::Create(len, std::clamp<size_t>(ring_bytes / len, 4, 4096));
+    if (!ring.ok()) {
+        printf("%-20s: memfd ring not available\n", name);
+        return;
+    }
+    auto seconds = RunPair([&]() {
+        for(size_t i = 0; i < count; ++i)
+            ring.push<IMP>(payload, len);
+    }, [&](pid_t) {
+        for(size_t i = 0; i < count; ++i) {
+            auto idx = ring.peek();
+            *sink += touch(ring.data(idx), ring.length(idx));
+            ring.release();
+        }
+    });
+    Report(name, len, count, seconds);
+}
+
+// producer builds the payload in the slot (one store per cache line), only the slot index crosses
+static void RingZeroCopyTest(size_t len, size_t count, uint64_t* sink) {
+    auto ring = ShmRing::Create(len, std::clamp<size_t>(ring_bytes / len, 4, 4096));
+    if (!ring.ok()) {
+        printf("%-20s: memfd ring not available\n", "ring zero-copy");
+        return;
+    }
+    auto seconds = RunPair([&]() {
+        for(size_t i = 0; i < count; ++i) {
+            auto slot = (uint8_t*)ring.data(ring.acquire());
+            for(size_t off = 0; off < len; off += 64)
+                *(volatile uint64_t*)(slot + off) = i + off;
+            ring.publish(len);
+        }
+    }, [&](pid_t) {
+        for(size_t i = 0; i < count; ++i) {
+            auto idx = ring.peek();
+            *sink += touch(ring.data(idx), ring.length(idx));
+            ring.release();
+        }
+    });
+    Report("ring zero-copy", len, count, seconds);
+}
+
+// a consumer that stops early closes its read end, the producer's next write fails and it exits
+static void PipeTest(const void* payload, size_t len, size_t count, uint64_t* sink) {
+    int fds[2];
+    if (pipe(fds) != 0)
+        return;
+    fcntl(fds[1], F_SETPIPE_SZ, 1024 * 1024);
+    std::vector<uint8_t> buf(len);
+    bool complete = true;
+    int err = 0;
+    auto seconds = RunPair([&]() {
+        close(fds[0]);
+        signal(SIGPIPE, SIG_IGN); // EPIPE instead
+        for(size_t i = 0; i < count; ++i) {
+            for(size_t off = 0; off < len;) {
+                auto n = write(fds[1], (const uint8_t*)payload + off, len - off);
+                if (n <= 0)
+                    return;
+                off += n;
+            }
+        }
+    }, [&](pid_t) {
+        close(fds[1]);
+        for(size_t i = 0; i < count && complete; ++i) {
+            for(size_t off = 0; off < len;) {
+                auto n = read(fds[0], buf.data() + off, len - off);
+                if (n <= 0) {
+                    complete = false;
+                    err = n < 0 ? errno : 0;
+                    break;
+                }
+                off += n;
+            }
+            *sink += touch(buf.data(), len);
+        }
+        close(fds[0]); // before waitpid, a blocked producer must see it
+    });
+    if (complete)
+        Report("pipe", len, count, seconds);
+    else
+        printf("%-20s: %s\n", "pipe", err ? strerror(err) : "producer stopped early");
+}
+
+// the ring only carries the producer's address, the consumer pulls the payload itself.
+// the producer stays alive until the consumer is done, the reads need the process
+static void VmReadvTest(const void* payload, size_t len, size_t count, uint64_t* sink) {
+    struct Msg {
+        const void* addr;
+        size_t len;
+    };
+    auto ring = ShmRing::Create(sizeof(Msg), 1024);
+    int done[2];
+    if (!ring.ok() || pipe(done) != 0)
+        return;
+    std::vector<uint8_t> buf(len);
+    int err = 0;
+    auto seconds = RunPair([&]() {
+        close(done[1]);
+        for(size_t i = 0; i < count; ++i) {
+            auto idx = ring.acquire();
+            *(Msg*)ring.data(idx) = Msg{ payload, len };
+            ring.publish(sizeof(Msg));
+        }
+        char c;
+        while(read(done[0], &c, 1) < 0 && errno == EINTR)
+            ;
+    }, [&](pid_t pid) {
+        for(size_t i = 0; i < count; ++i) {
+            auto idx = ring.peek();
+            auto msg = *(const Msg*)ring.data(idx);
+            iovec local{ buf.data(), msg.len };
+            iovec remote{ (void*)msg.addr, msg.len };
+            if (err == 0 && process_vm_readv(pid, &local, 1, &remote, 1, 0) != (ssize_t)msg.len)
+                err = errno ? errno : EIO;
+            ring.release(); // the slot may be reused only after the read
+            *sink += touch(buf.data(), len);
+        }
+        close(done[1]); // lets the producer exit
+    });
+    close(done[0]);
+    if (err == 0)
+        Report("process_vm_readv", len, count, seconds);
+    else if (err == EPERM || err == EACCES)
+        printf("%-20s: not permitted\n", "process_vm_readv");
+    else
+        printf("%-20s: %s\n", "process_vm_readv", strerror(err));
+}
+
+int main(int, char**) {
+    std::vector<size_t> sizes = { 64, 256, 1024, 4096, 16384, 65536, 1024 * 1024, 8 * 1024 * 1024 };
+    ApplyMachineProfile(MachineProfile::Load());
+
+    auto payload = (uint8_t*)mmap(nullptr, sizes.back(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (payload == MAP_FAILED)
+        return 1;
+    for(size_t i = 0; i < sizes.back(); ++i)
+        payload[i] = (uint8_t)i;
+
+    uint64_t sink = 0;
+    for(auto len: sizes) {
+        size_t count = std::clamp<size_t>(total_bytes / len, 1000, 2 * 1024 * 1024);
+        RingZeroCopyTest(len, count, &sink);
+        RingCopyTest<STD>("ring std::memcpy", payload, len, count, &sink);
+        RingCopyTest<SIMD>("ring simdpp", payload, len, count, &sink);
+        RingCopyTest<FastMemcpy>("ring FastMemcpy", payload, len, count, &sink);
+        if (len % 65536 == 0) // TmpTest works in 64K rows
+            RingCopyTest<TmpTest>("ring TmpTest", payload, len, count, &sink);
+        PipeTest(payload, len, count, &sink);
+        VmReadvTest(payload, len, count, &sink);
+        printf("%s", "\n");
+    }
+
+    munmap(payload, sizes.back());
+    printf("%llu\rEnd.\n", (unsigned long long)sink);
+
+    return 0;
+}
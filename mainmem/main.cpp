@@ -1,6 +1,3 @@
-#define SIMDPP_ARCH_X86_AVX2
-#include "simdpp/simd.h"
-
 #include <malloc.h>
 #include <cstdio>
 #include <vector>
@@ -11,60 +8,14 @@
 #include <thread>
 #include <random>
 #include <functional>
-#include <FastMemcpy_Avx.h>
-
-struct STD {
-    static void cpy(void* dst, const void* src, intptr_t size) {
-        std::memcpy(dst, src, size);
-    }
-};
-
-struct ALG {
-    static void cpy(void* dst, const void* src, intptr_t size) {
-        std::copy_n((const char*)src, size, (char*)dst);
-    }
-};
-
-struct SIMD {
-    static void cpy(void* dst, const void* src, intptr_t size) {
-        register simdpp::int64x4 tmp;
-        for(int i = 0; i < size; i += 32) {
-            tmp = simdpp::load((const char*)src + i);
-            simdpp::prefetch_read((const char*)src + i + 512);
-            simdpp::stream((char*)dst + i, tmp);
-        }
-        std::atomic_thread_fence(std::memory_order_seq_cst);
-    }
-};
-
-struct FastMemcpy {
-    static void cpy(void* dst, const void* src, intptr_t size) {
-        memcpy_fast(dst, src, size);
-    }
-};
-
-struct TmpTest {
-    static void cpy(void* dst, const void* src, intptr_t size) {
-        auto ps = (const uint8_t*) src;
-        auto pd = (uint8_t*) dst;
-
-        int us = 0;
-        // 一个内存行一个内存行处理
-        for(int off = 0; off < size; off += 65536) {
-            // 先cache来源的内存行
-            for(int cl = 0; cl < 65536; cl += 64)
-                us += ps[off + cl];
-            // 复制
-            memcpy(pd + off, ps + off, 65536);
-        }
-    }
-};
+
+#include "copy_impl.h"
+#include "bench_runner.h"
 
 const size_t size = 1024 * 1024 * 1024; // 1024 MB
-const size_t loop = 30;
 
 template<class IMP>
-void DoTest(const char* name, std::atomic_int64_t* speedBps) {
+void DoTest(const char* name, std::atomic_int64_t* speedBps, bench::Runner* runner) {
     void* src = _aligned_malloc(size, 65536);
     void* dst = _aligned_malloc(size, 65536);
     for(int i = 0; i < 3; ++i) // warm up
@@ -72,22 +23,34 @@ void DoTest(const char* name, std::atomic_int64_t* speedBps) {
 
     using namespace std::chrono;
 
-    auto begin = steady_clock::now();
-    for(int i = 0; i < loop; ++i) {
+    // one copy per trial, MB/S
+    auto samples = bench::Collect(runner->options(), [&]() {
+        auto begin = steady_clock::now();
         IMP::cpy(dst, src, size);
-    }
-    auto cost = steady_clock::now() - begin;
-    auto speed = (size * loop) / 1048576.0 / (duration_cast<nanoseconds>(cost).count() / 1000000000.0);
-    
+        auto cost = steady_clock::now() - begin;
+        return size / 1048576.0 / (duration_cast<nanoseconds>(cost).count() / 1000000000.0);
+    });
+    auto speed = bench::Summarize(samples).median;
+
     printf("using %s: %g MB/S\n", name, speed);
 
-    speedBps->fetch_add(size * loop / (duration_cast<nanoseconds>(cost).count() / 1000000000.0));
+    speedBps->fetch_add((int64_t)(speed * 1048576.0));
+    runner->Add(std::string(name) + " per thread", "MB/S", samples, false);
 
     _aligned_free(src);
     _aligned_free(dst);
 }
 
-int main(int, char**){
+int main(int argc, char** argv){
+    bench::Options defaults;
+    defaults.min_trials = 10;
+    defaults.max_trials = 30;
+    bench::Runner runner("memcpytest", bench::Options::Parse(argc, argv, defaults));
+
+    auto prof = MachineProfile::Load();
+    prof.Print();
+    ApplyMachineProfile(prof);
+
     // const int parallel = std::thread::hardware_concurrency();
     const int parallel = 8;
     std::vector<std::thread> t;
@@ -100,10 +63,10 @@ int main(int, char**){
         t.emplace_back([&]() {
             std::vector<std::function<void()>> funcs;
 
-            funcs.emplace_back([&]() { DoTest<STD>("std::memcpy", &memcpyBps); });
-            funcs.emplace_back([&]() { DoTest<SIMD>("simdpp", &simdppBps); });
-            funcs.emplace_back([&]() { DoTest<FastMemcpy>("FastMemcpy", &fastmemcpyBps); });
-            funcs.emplace_back([&]() { DoTest<TmpTest>("TmpTest", &tmptestBps); });
+            funcs.emplace_back([&]() { DoTest<STD>("std::memcpy", &memcpyBps, &runner); });
+            funcs.emplace_back([&]() { DoTest<SIMD>("simdpp", &simdppBps, &runner); });
+            funcs.emplace_back([&]() { DoTest<FastMemcpy>("FastMemcpy", &fastmemcpyBps, &runner); });
+            funcs.emplace_back([&]() { DoTest<TmpTest>("TmpTest", &tmptestBps, &runner); });
 
             std::mt19937 mt(std::random_device{}());
             std::shuffle(funcs.begin(), funcs.end(), mt);
@@ -121,10 +84,17 @@ int main(int, char**){
     printf("FastMemcpy %g MB/S\n", fastmemcpyBps.load() / 1048576.0);
     printf("TmpTest %g MB/S\n", tmptestBps.load() / 1048576.0);
 
-    printf("%s", "End.\n");
+    // total = sum of per thread medians
+    runner.Add("std::memcpy total", "MB/S", { memcpyBps.load() / 1048576.0 }, false);
+    runner.Add("simdpp total", "MB/S", { simdppBps.load() / 1048576.0 }, false);
+    runner.Add("FastMemcpy total", "MB/S", { fastmemcpyBps.load() / 1048576.0 }, false);
+    runner.Add("TmpTest total", "MB/S", { tmptestBps.load() / 1048576.0 }, false);
 
-    int dummy;
-    scanf("%d", &dummy);
+    printf("%s", "\nPer thread\n");
+    for(auto name: { "std::memcpy", "simdpp", "FastMemcpy", "TmpTest" })
+        runner.Print(std::string(name) + " per thread");
+
+    printf("%s", "End.\n");
 
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,181 @@
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <functional>
+#include <algorithm>
+
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE 23 // linux 5.14
+#endif
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+
+const size_t size = 1024 * 1024 * 1024; // 1024 MB
+const size_t loop = 5;
+
+// backing page of the buffer under test
+struct PageKind {
+    const char* name;
+    size_t pagesize;
+    int mmapflags;
+    bool thp;
+};
+
+static void* map_buffer(const PageKind& kind, int extraflags) {
+    void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | kind.mmapflags | extraflags, -1, 0);
+    if (p == MAP_FAILED)
+        return nullptr;
+    if (kind.thp)
+        madvise(p, size, MADV_HUGEPAGE);
+    else if (kind.pagesize == 4096)
+        madvise(p, size, MADV_NOHUGEPAGE);
+    return p;
+}
+
+// bytes of [p, p + bytes) the kernel put on transparent huge pages (AnonHugePages in smaps)
+static size_t anon_huge_bytes(const void* p, size_t bytes) {
+    FILE* f = fopen("/proc/self/smaps", "r");
+    if (!f)
+        return 0;
+    const uintptr_t lo = (uintptr_t)p, hi = lo + bytes;
+    size_t huge = 0, overlap = 0;
+    char line[256];
+    while(fgets(line, sizeof(line), f)) {
+        unsigned long long start, end;
+        size_t kb;
+        if (sscanf(line, "%llx-%llx ", &start, &end) == 2)
+            overlap = end > lo && start < hi ? std::min<uintptr_t>(hi, end) - std::max<uintptr_t>(lo, start) : 0;
+        else if (overlap && sscanf(line, "AnonHugePages: %zu kB", &kb) == 1)
+            huge += std::min(overlap, kb * 1024);
+    }
+    fclose(f);
+    return huge;
+}
+
+// touch one byte per page, the cost is all page fault
+static void touch_pages(void* p, size_t bytes, size_t step) {
+    auto pb = (volatile uint8_t*)p;
+    for(size_t off = 0; off < bytes; off += step)
+        pb[off] = 1;
+}
+
+// spread the faults over threads, each thread owns a contiguous slice
+static void parallel_prefault(void* p, size_t bytes, size_t pagesize, int threads) {
+    size_t pages = bytes / pagesize;
+    size_t per = (pages + threads - 1) / threads;
+    std::vector<std::thread> t;
+    for(int i = 0; i < threads; ++i) {
+        size_t first = i * per;
+        size_t last = std::min(pages, first + per);
+        if (first >= last)
+            break;
+        t.emplace_back([=]() {
+            touch_pages((uint8_t*)p + first * pagesize, (last - first) * pagesize, pagesize);
+        });
+    }
+    for(auto& th: t)
+        th.join();
+}
+
+int main(int, char**) {
+    using namespace std::chrono;
+
+    const int parallel = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<uint8_t> src(size, 1);
+
+    std::vector<PageKind> kinds = {
+        { "4K", 4096, 0, false },
+        { "2M THP", 2 * 1048576, 0, true },
+        { "2M hugetlb", 2 * 1048576, MAP_HUGETLB | (21 << MAP_HUGE_SHIFT), false },
+        { "1G hugetlb", 1024 * 1048576, MAP_HUGETLB | (30 << MAP_HUGE_SHIFT), false },
+    };
+
+    printf("buffer: %zu MB, prefault threads: %d\n", size / 1048576, parallel);
+
+    for(auto& kind: kinds) {
+        // MADV_POPULATE_WRITE needs linux 5.14, probed once instead of timing a fallback under its name
+        // THP is a hint: with it off the faults are 4K ones, not worth a row under the 2M name.
+        // the mapping isn't 2M aligned, the partial pages at both ends stay 4K
+        bool populate_write = false;
+        if (void* probe = map_buffer(kind, 0)) {
+            populate_write = madvise(probe, kind.pagesize, MADV_POPULATE_WRITE) == 0;
+            size_t huge = size;
+            if (kind.thp) {
+                touch_pages(probe, size, 4096);
+                huge = anon_huge_bytes(probe, size);
+            }
+            munmap(probe, size);
+            if (huge + 2 * kind.pagesize < size) {
+                printf("%-12s: only %zu of %zu MB on huge pages (THP off?), skipped\n", kind.name, huge / 1048576, size / 1048576);
+                continue;
+            }
+        } else {
+            printf("%-12s: not available\n", kind.name);
+            continue;
+        }
+
+        // first time the buffer is used, then all later copies are warm
+        auto measure = [&](const char* name, int extraflags, std::function<void(void*)> prepare) {
+            double prepare_ns = 0, cold_ns = 0, warm_ns = 0;
+            for(size_t i = 0; i < loop; ++i) {
+                auto begin = steady_clock::now();
+                void* dst = map_buffer(kind, extraflags);
+                if (!dst) {
+                    printf("%-12s %-22s: not available\n", kind.name, name);
+                    return;
+                }
+                if (prepare)
+                    prepare(dst);
+                auto prepared = steady_clock::now();
+                memcpy(dst, src.data(), size);
+                auto cold = steady_clock::now();
+                memcpy(dst, src.data(), size);
+                auto warm = steady_clock::now();
+                munmap(dst, size);
+
+                prepare_ns += duration_cast<nanoseconds>(prepared - begin).count();
+                cold_ns += duration_cast<nanoseconds>(cold - prepared).count();
+                warm_ns += duration_cast<nanoseconds>(warm - cold).count();
+            }
+            prepare_ns /= loop;
+            cold_ns /= loop;
+            warm_ns /= loop;
+
+            // first touch = everything that the warm copy doesn't pay
+            double firsttouch_ns = prepare_ns + cold_ns - warm_ns;
+            printf("%-12s %-22s: prepare %8.2f ms, first copy %8.2f ms, warm copy %8.2f ms, first touch %8.1f ns/page (%g ns/4K)\n",
+                kind.name, name,
+                prepare_ns / 1e6, cold_ns / 1e6, warm_ns / 1e6,
+                firsttouch_ns / (size / kind.pagesize),
+                firsttouch_ns / (size / 4096));
+        };
+
+        measure("fault on copy", 0, nullptr);
+        measure("touch", 0, [&](void* p) { touch_pages(p, size, kind.pagesize); });
+        measure("MAP_POPULATE", MAP_POPULATE, nullptr);
+        measure("MADV_WILLNEED + touch", 0, [&](void* p) {
+            madvise(p, size, MADV_WILLNEED);
+            touch_pages(p, size, kind.pagesize);
+        });
+        if (populate_write)
+            measure("MADV_POPULATE_WRITE", 0, [&](void* p) { madvise(p, size, MADV_POPULATE_WRITE); });
+        else
+            printf("%-12s %-22s: not supported\n", kind.name, "MADV_POPULATE_WRITE");
+        measure("parallel touch", 0, [&](void* p) {
+            parallel_prefault(p, size, kind.pagesize, parallel);
+        });
+    }
+
+    printf("%s", "End.\n");
+
+    return 0;
+}
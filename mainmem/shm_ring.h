@@ -0,0 +1,162 @@
+#pragma once
+
+#include <sys/mman.h>
+#include <unistd.h>
+#include <sched.h>
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <utility>
+#include <new>
+
+// single producer single consumer ring in a memfd, usable across fork() or by passing the fd
+// head and tail live on their own cache lines, each side keeps a private copy of the other's index
+class ShmRing {
+public:
+    static constexpr size_t cacheline = 64;
+
+private:
+    struct Header {
+        alignas(cacheline) std::atomic<uint64_t> tail; // written by producer
+        alignas(cacheline) std::atomic<uint64_t> head; // written by consumer
+        alignas(cacheline) uint64_t slot_size;
+        uint64_t slot_count;
+    };
+
+    // payload length is stored in front of each slot, data stays cache line aligned
+    struct alignas(cacheline) SlotHeader {
+        uint64_t len;
+    };
+
+    int fd_ = -1;
+    size_t map_size_ = 0;
+    Header* hdr_ = nullptr;
+    uint8_t* slots_ = nullptr;
+    size_t stride_ = 0;
+
+    // side-local, never shared
+    uint64_t cached_head_ = 0;
+    uint64_t cached_tail_ = 0;
+    uint64_t pos_ = 0;
+
+    static size_t round_up(size_t v) { return (v + cacheline - 1) / cacheline * cacheline; }
+
+    SlotHeader* slot(uint64_t index) const {
+        return (SlotHeader*)(slots_ + (index % hdr_->slot_count) * stride_);
+    }
+
+    template<class Cond>
+    static void wait(Cond&& cond) {
+        for(int spin = 0; !cond(); ++spin) {
+            if (spin > 1000)
+                sched_yield();
+        }
+    }
+
+public:
+    ShmRing() = default;
+    ShmRing(const ShmRing&) = delete;
+    ShmRing& operator=(const ShmRing&) = delete;
+    ShmRing(ShmRing&& r) noexcept { *this = std::move(r); }
+    ShmRing& operator=(ShmRing&& r) noexcept {
+        std::swap(fd_, r.fd_);
+        std::swap(map_size_, r.map_size_);
+        std::swap(hdr_, r.hdr_);
+        std::swap(slots_, r.slots_);
+        std::swap(stride_, r.stride_);
+        std::swap(cached_head_, r.cached_head_);
+        std::swap(cached_tail_, r.cached_tail_);
+        std::swap(pos_, r.pos_);
+        return *this;
+    }
+
+    ~ShmRing() {
+        if (hdr_)
+            munmap(hdr_, map_size_);
+        if (fd_ >= 0)
+            close(fd_);
+    }
+
+    // returns an empty ring (ok() == false) on failure
+    static ShmRing Create(size_t slot_size, size_t slot_count) {
+        ShmRing r;
+        r.stride_ = sizeof(SlotHeader) + round_up(slot_size);
+        r.map_size_ = sizeof(Header) + r.stride_ * slot_count;
+        r.fd_ = memfd_create("shm_ring", MFD_CLOEXEC);
+        if (r.fd_ < 0 || ftruncate(r.fd_, r.map_size_) != 0)
+            return r;
+        void* p = mmap(nullptr, r.map_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r.fd_, 0);
+        if (p == MAP_FAILED)
+            return r;
+        r.hdr_ = new(p) Header{};
+        r.hdr_->slot_size = slot_size;
+        r.hdr_->slot_count = slot_count;
+        r.slots_ = (uint8_t*)p + sizeof(Header);
+        return r;
+    }
+
+    // map a ring created by another process, fd is taken over
+    static ShmRing Attach(int fd) {
+        ShmRing r;
+        r.fd_ = fd;
+        Header probe;
+        if (pread(fd, &probe.slot_size, sizeof(uint64_t) * 2, offsetof(Header, slot_size)) != sizeof(uint64_t) * 2)
+            return r;
+        r.stride_ = sizeof(SlotHeader) + round_up(probe.slot_size);
+        r.map_size_ = sizeof(Header) + r.stride_ * probe.slot_count;
+        void* p = mmap(nullptr, r.map_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+        if (p == MAP_FAILED)
+            return r;
+        r.hdr_ = (Header*)p;
+        r.slots_ = (uint8_t*)p + sizeof(Header);
+        return r;
+    }
+
+    bool ok() const { return hdr_ != nullptr; }
+    int fd() const { return fd_; }
+    size_t slot_size() const { return hdr_->slot_size; }
+    size_t slot_count() const { return hdr_->slot_count; }
+
+    // producer: wait for a free slot, fill it through data(), then publish()
+    uint64_t acquire() {
+        wait([&]() {
+            if (pos_ - cached_head_ < hdr_->slot_count)
+                return true;
+            cached_head_ = hdr_->head.load(std::memory_order_acquire);
+            return pos_ - cached_head_ < hdr_->slot_count;
+        });
+        return pos_;
+    }
+
+    void publish(size_t len) {
+        slot(pos_)->len = len;
+        hdr_->tail.store(++pos_, std::memory_order_release);
+    }
+
+    // copy in with one of copy_impl.h IMPs, len must fit slot_size()
+    template<class IMP>
+    void push(const void* src, size_t len) {
+        IMP::cpy(data(acquire()), src, len);
+        publish(len);
+    }
+
+    // consumer: wait for a published slot, read it in place through data(), then release()
+    uint64_t peek() {
+        wait([&]() {
+            if (cached_tail_ > pos_)
+                return true;
+            cached_tail_ = hdr_->tail.load(std::memory_order_acquire);
+            return cached_tail_ > pos_;
+        });
+        return pos_;
+    }
+
+    size_t length(uint64_t index) const { return slot(index)->len; }
+
+    void release() {
+        hdr_->head.store(++pos_, std::memory_order_release);
+    }
+
+    void* data(uint64_t index) const { return slot(index) + 1; }
+};
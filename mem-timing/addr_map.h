@@ -0,0 +1,284 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#include "bench_runner.h"
+#include "timing_common.h"
+
+// physical address -> bank, as xor functions over address bits (DRAMA, Pessl et al. 2016)
+//
+// two addresses in the same bank but different rows can't both have their row open:
+// reading them alternately is slower than any other pair. addresses that conflict with the
+// same base form a same-bank set, and a bank function is a bit mask whose parity is the same
+// for every address of every set but differs across the whole pool.
+
+struct AddressMapping {
+    std::vector<uint64_t> functions; // bit masks, bank index bit i = parity(addr & functions[i])
+    bool physical = false;           // false: only offsets inside one huge page were known
+    int low_bit = 6;
+    int high_bit = 0;                // bits >= high_bit were not resolvable
+
+    int Bank(uint64_t addr) const {
+        int b = 0;
+        for(size_t i = 0; i < functions.size(); ++i)
+            b |= Parity64(addr & functions[i]) << i;
+        return b;
+    }
+
+    static std::string Bits(uint64_t mask) {
+        std::string s;
+        for(int b = 0; b < 64; ++b) {
+            if (mask >> b & 1)
+                s += (s.empty() ? "" : " ^ ") + std::to_string(b);
+        }
+        return s;
+    }
+
+    void Print() const {
+        printf("%zu bank functions over bits %d..%d (%s):\n", functions.size(), low_bit, high_bit - 1,
+            physical ? "physical" : "huge page offset only");
+        for(auto f: functions)
+            printf("  %s\n", Bits(f).c_str());
+    }
+};
+
+#ifdef __linux__
+
+namespace addr_map_detail {
+
+struct Pool {
+    uint8_t* base = nullptr;
+    size_t size = 0;
+    size_t page = 0;      // physically contiguous unit
+    const char* kind = "";
+    void* map = nullptr;  // for munmap
+    size_t map_size = 0;
+};
+
+inline Pool AllocPool(size_t size) {
+    Pool p;
+#ifdef MAP_HUGE_1GB
+    void* m = mmap(nullptr, 1ull << 30, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_HUGE_1GB, -1, 0);
+    if (m != MAP_FAILED)
+        return Pool{ (uint8_t*)m, 1ull << 30, 1ull << 30, "1G hugetlb", m, 1ull << 30 };
+#endif
+    void* h = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (h != MAP_FAILED)
+        return Pool{ (uint8_t*)h, size, 2u << 20, "2M hugetlb", h, size };
+    // transparent huge pages, 2M aligned, not guaranteed: touched and checked in smaps, any
+    // 4K page in the pool and the contiguous unit is 4K
+    uint8_t* a = (uint8_t*)mmap(nullptr, size + (2u << 20), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (a == MAP_FAILED)
+        return p;
+    uint8_t* aligned = (uint8_t*)(((uintptr_t)a + (2u << 20) - 1) & ~(uintptr_t)((2u << 20) - 1));
+    madvise(aligned, size, MADV_HUGEPAGE);
+    for(size_t i = 0; i < size; i += 4096)
+        aligned[i] = 1;
+    if (HugePageBytes(aligned, size) < size)
+        return Pool{ aligned, size, 4096, "4K pages (THP not available)", a, size + (2u << 20) };
+    return Pool{ aligned, size, 2u << 20, "2M THP", a, size + (2u << 20) };
+}
+
+// physical address of every page, empty if pagemap hides the frame numbers (no CAP_SYS_ADMIN)
+inline std::vector<uint64_t> PhysicalPages(const Pool& pool) {
+    std::vector<uint64_t> phys;
+    int fd = open("/proc/self/pagemap", O_RDONLY);
+    if (fd < 0)
+        return phys;
+    for(size_t off = 0; off < pool.size; off += pool.page) {
+        uint64_t entry = 0;
+        uintptr_t v = (uintptr_t)(pool.base + off);
+        if (pread(fd, &entry, 8, (off_t)(v / 4096 * 8)) != 8 || !(entry >> 63 & 1) || (entry & ((1ull << 55) - 1)) == 0) {
+            phys.clear();
+            break;
+        }
+        phys.push_back((entry & ((1ull << 55) - 1)) * 4096);
+    }
+    close(fd);
+    return phys;
+}
+
+// ns per round of reading a and b with both flushed, the two loads overlap
+inline double PairLatency(const uint8_t* a, const uint8_t* b, int rounds) {
+    volatile uint64_t sink = 0;
+    std::vector<double> t(rounds);
+    for(int i = 0; i < rounds; ++i) {
+        FlushLine(a);
+        FlushLine(b);
+        FullFence();
+        StopWatch w;
+        sink += *(volatile const uint64_t*)a;
+        sink += *(volatile const uint64_t*)b;
+        FullFence();
+        t[i] = (double)w.cost_ns();
+    }
+    std::nth_element(t.begin(), t.begin() + rounds / 2, t.end());
+    return t[rounds / 2];
+}
+
+// row conflicts are a small slow population: the largest gap above the median
+inline double ConflictThreshold(std::vector<double> lat) {
+    std::sort(lat.begin(), lat.end());
+    size_t lo = lat.size() / 2;
+    size_t hi = lat.size() - std::max<size_t>(lat.size() / 200, 1); // drop outliers
+    double best = 0, threshold = 0;
+    for(size_t i = lo; i + 1 < hi; ++i) {
+        if (lat[i + 1] - lat[i] > best) {
+            best = lat[i + 1] - lat[i];
+            threshold = (lat[i + 1] + lat[i]) / 2;
+        }
+    }
+    return best > lat[lo] * 0.05 ? threshold : 0;
+}
+
+inline bool Independent(std::vector<uint64_t>& basis, uint64_t m) {
+    for(auto b: basis) { // basis kept reduced by leading bit
+        uint64_t top = 1ull << (63 - __builtin_clzll(b));
+        if (m & top)
+            m ^= b;
+    }
+    if (!m)
+        return false;
+    basis.push_back(m);
+    std::sort(basis.begin(), basis.end(), std::greater<uint64_t>());
+    return true;
+}
+
+} // namespace addr_map_detail
+
+// mem-timing addrmap [--pool=bytes] [--addrs=n] [--sets=n] [--max-bits=n] [--rounds=n]
+inline int RunAddrMap(bench::Runner& runner, int argc, char** argv) {
+    using namespace addr_map_detail;
+    const size_t pool_size = (size_t)ArgInt(argc, argv, "--pool=", 256 * 1024 * 1024);
+    const int addrs = (int)ArgInt(argc, argv, "--addrs=", 3000);
+    const int sets = (int)ArgInt(argc, argv, "--sets=", 8);
+    const int max_bits = (int)ArgInt(argc, argv, "--max-bits=", 6);
+    const int rounds = (int)ArgInt(argc, argv, "--rounds=", 15);
+
+    Pool pool = AllocPool(pool_size);
+    if (!pool.base) {
+        printf("%s", "out of memory.\n");
+        return 1;
+    }
+    for(size_t i = 0; i < pool.size; i += 4096)
+        pool.base[i] = 1;
+
+    AddressMapping map;
+    std::vector<uint64_t> phys = PhysicalPages(pool);
+    map.physical = !phys.empty();
+    size_t span = pool.size; // addresses are picked from [0, span)
+    if (!map.physical) {
+        // without frame numbers only the offset inside one contiguous page is known
+        span = pool.page;
+        printf("no physical addresses from /proc/self/pagemap (needs root), using offsets inside one %s page\n", pool.kind);
+    }
+    auto addr_of = [&](size_t off) -> uint64_t {
+        return map.physical ? phys[off / pool.page] + off % pool.page : off;
+    };
+    uint64_t highest = 0;
+    for(size_t off = 0; off < span; off += pool.page)
+        highest = std::max(highest, addr_of(off) + pool.page - 1);
+    map.high_bit = 64 - __builtin_clzll(highest);
+    map.high_bit = std::min(map.high_bit, 40);
+    printf("pool: %zu MB of %s, address bits %d..%d\n", pool.size >> 20, pool.kind, map.low_bit, map.high_bit - 1);
+
+    std::mt19937_64 mt(7);
+    std::vector<size_t> offs(addrs);
+    for(auto& o: offs)
+        o = (mt() % span) & ~(size_t)63;
+
+    // same-bank sets around random bases
+    std::vector<std::vector<uint64_t>> banks;
+    std::vector<double> all_lat;
+    for(int s = 0; s < sets * 3 && (int)banks.size() < sets; ++s) {
+        size_t base = offs[mt() % offs.size()];
+        std::vector<double> lat(offs.size());
+        for(size_t i = 0; i < offs.size(); ++i)
+            lat[i] = PairLatency(pool.base + base, pool.base + offs[i], rounds);
+        double threshold = ConflictThreshold(lat);
+        if (threshold == 0)
+            continue;
+        std::vector<uint64_t> same = { addr_of(base) };
+        for(size_t i = 0; i < offs.size(); ++i) {
+            if (lat[i] > threshold && offs[i] != base)
+                same.push_back(addr_of(offs[i]));
+        }
+        printf("  set %zu: threshold %.0f ns, %zu addresses\n", banks.size(), threshold, same.size());
+        if (same.size() < 4 || same.size() > offs.size() / 4)
+            continue; // no clear conflict population
+        banks.push_back(same);
+        all_lat.insert(all_lat.end(), lat.begin(), lat.end());
+    }
+    if (banks.empty()) {
+        printf("%s", "no row conflict signal (VM, or the timer is too coarse).\n");
+        munmap(pool.map, pool.map_size);
+        return 0;
+    }
+    std::sort(all_lat.begin(), all_lat.end());
+    runner.Add("addrmap pair latency", "ns", all_lat, false);
+    printf("pair latency median %.0f ns, p99 %.0f ns\n", bench::Percentile(all_lat, 0.5), bench::Percentile(all_lat, 0.99));
+
+    // every mask of up to max_bits bits that is constant in each set and splits the pool
+    std::vector<uint64_t> candidates;
+    std::vector<int> bits;
+    for(int b = map.low_bit; b < map.high_bit; ++b)
+        bits.push_back(b);
+    auto check = [&](uint64_t m) {
+        for(auto& set: banks) {
+            int p = Parity64(set[0] & m);
+            for(auto a: set) {
+                if (Parity64(a & m) != p)
+                    return;
+            }
+        }
+        int ones = 0;
+        for(auto o: offs)
+            ones += Parity64(addr_of(o) & m);
+        if (ones > addrs / 4 && ones < addrs * 3 / 4)
+            candidates.push_back(m);
+    };
+    auto enumerate = [&](auto& self, size_t from, int depth, uint64_t m) -> void {
+        if (m)
+            check(m);
+        if (depth == max_bits)
+            return;
+        for(size_t i = from; i < bits.size(); ++i)
+            self(self, i + 1, depth + 1, m | 1ull << bits[i]);
+    };
+    enumerate(enumerate, 0, 0, 0);
+
+    // lowest weight masks first, keep a linearly independent set
+    std::stable_sort(candidates.begin(), candidates.end(), [](uint64_t a, uint64_t b) {
+        return __builtin_popcountll(a) < __builtin_popcountll(b);
+    });
+    std::vector<uint64_t> basis;
+    for(auto m: candidates) {
+        if (Independent(basis, m))
+            map.functions.push_back(m);
+    }
+    map.Print();
+    printf("%zu candidate masks, %d banks x channels x ranks\n", candidates.size(), 1 << map.functions.size());
+
+    munmap(pool.map, pool.map_size);
+    return 0;
+}
+
+#else
+
+inline int RunAddrMap(bench::Runner&, int, char**) {
+    printf("%s", "addrmap needs Linux (hugetlb, /proc/self/pagemap).\n");
+    return 1;
+}
+
+#endif
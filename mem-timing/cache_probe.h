@@ -0,0 +1,298 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <random>
+#include <fstream>
+#include <cmath>
+#include <algorithm>
+
+#include "bench_runner.h"
+#include "machine_profile.h"
+#include "timing_common.h"
+#include "dram_geometry.h"
+#include "pointer_chase.h"
+
+// cache sizes from random chase latency plateaus, line size from same-block pairs,
+// associativity from addresses one cache size apart, cross-checked with cpuid and sysfs
+
+namespace cache_probe_detail {
+
+inline double ChaseLatency(bench::Runner& runner, const std::string& name, void** p, int64_t nodes) {
+    const int64_t steps = std::max<int64_t>(nodes * 2, 1 << 20) / 8 * 8;
+    p = Chase(p, nodes);
+    auto samples = bench::Collect(runner.options(), [&]() {
+        StopWatch w;
+        p = Chase(p, steps);
+        return (double)w.cost_ns() / steps;
+    });
+    volatile uintptr_t sink = (uintptr_t)p;
+    (void)sink;
+    return runner.Add(name, "ns", samples, false).stats.median;
+}
+
+struct Level {
+    int64_t size;       // effective size, where the latency is half way to the next level
+    double latency;     // median of the plateau
+};
+
+// a transition is a run of >15% steps that rises >40% in total, the plateaus are between them
+inline std::vector<Level> FindLevels(const std::vector<int64_t>& ws, const std::vector<double>& lat) {
+    auto median = [&](size_t begin, size_t end) {
+        std::vector<double> v(lat.begin() + begin, lat.begin() + end);
+        std::sort(v.begin(), v.end());
+        return v[v.size() / 2];
+    };
+    std::vector<std::pair<size_t, size_t>> plateaus; // [begin, end)
+    size_t plateau_begin = 0;
+    size_t i = 0;
+    while(i + 1 < lat.size()) {
+        if (lat[i + 1] <= lat[i] * 1.15) {
+            ++i;
+            continue;
+        }
+        size_t run = i;
+        while(run + 1 < lat.size() && lat[run + 1] > lat[run] * 1.15)
+            ++run;
+        if (lat[run] > lat[i] * 1.4) {
+            plateaus.push_back({ plateau_begin, i + 1 });
+            plateau_begin = run;
+        }
+        i = run;
+    }
+    plateaus.push_back({ plateau_begin, lat.size() }); // what is after the last transition is memory
+
+    std::vector<Level> levels;
+    for(size_t p = 0; p < plateaus.size(); ++p) {
+        Level l{ 0, median(plateaus[p].first, plateaus[p].second) };
+        if (p + 1 < plateaus.size()) {
+            // geometric interpolation of the crossing inside the transition
+            double mid = (l.latency + median(plateaus[p + 1].first, plateaus[p + 1].second)) / 2;
+            for(size_t j = plateaus[p].second - 1; j + 1 < lat.size(); ++j) {
+                if (lat[j + 1] >= mid) {
+                    double f = lat[j + 1] > lat[j] ? std::clamp((mid - lat[j]) / (lat[j + 1] - lat[j]), 0.0, 1.0) : 0;
+                    l.size = (int64_t)(ws[j] * std::pow((double)ws[j + 1] / ws[j], f)) / 4096 * 4096;
+                    break;
+                }
+            }
+        }
+        levels.push_back(l);
+    }
+    return levels;
+}
+
+// /sys/devices/system/cpu/cpu0/cache, data and unified caches by level
+inline bool FromSysfs(MachineProfile& p) {
+    bool found = false;
+    for(int idx = 0; idx < 8; ++idx) {
+        std::string dir = "/sys/devices/system/cpu/cpu0/cache/index" + std::to_string(idx) + "/";
+        std::ifstream flevel(dir + "level"), ftype(dir + "type"), fsize(dir + "size"), fways(dir + "ways_of_associativity"), fline(dir + "coherency_line_size");
+        int level = 0, ways = 0;
+        int64_t line = 0;
+        std::string type, size;
+        if (!(flevel >> level) || !(ftype >> type) || !(fsize >> size))
+            break;
+        if (type == "Instruction")
+            continue;
+        fways >> ways;
+        fline >> line;
+        int64_t bytes = atoll(size.c_str());
+        if (size.back() == 'K')
+            bytes *= 1024;
+        else if (size.back() == 'M')
+            bytes *= 1024 * 1024;
+        MachineProfile::Cache c{ bytes, ways, 0 };
+        if (level == 1) {
+            p.l1d = c;
+            if (line)
+                p.line_size = line;
+        } else if (level == 2) {
+            p.l2 = c;
+        } else if (level == 3) {
+            p.l3 = c;
+        }
+        found = true;
+    }
+    if (found)
+        p.source = "sysfs";
+    return found;
+}
+
+inline int64_t PowerOfTwoBelow(int64_t v) {
+    int64_t p = 1;
+    while(p * 2 <= v)
+        p *= 2;
+    return p;
+}
+
+// the l1d / l2 / l3 slot (0..2) of every cache plateau (not the memory one), -1 if none: the
+// reported level nearest in log size, a slot claimed twice goes to the closer plateau. a hidden
+// level (inclusive l2 under a big l3, a victim l3) leaves a gap instead of shifting the others
+inline std::vector<int> MatchLevels(const std::vector<Level>& levels, const MachineProfile::Cache* const ref[3]) {
+    const size_t n = levels.empty() ? 0 : levels.size() - 1;
+    std::vector<int> slot(n, -1);
+    std::vector<double> dist(n);
+    for(size_t l = 0; l < n; ++l) {
+        for(int k = 0; k < 3; ++k) {
+            if (ref[k]->size <= 0)
+                continue;
+            double d = std::abs(std::log2((double)levels[l].size / ref[k]->size));
+            if (slot[l] < 0 || d < dist[l]) {
+                slot[l] = k;
+                dist[l] = d;
+            }
+        }
+    }
+    for(size_t l = 0; l < n; ++l) {
+        for(size_t o = 0; o < n; ++o) {
+            if (o != l && slot[o] == slot[l] && slot[l] >= 0 && (dist[o] < dist[l] || (dist[o] == dist[l] && o < l)))
+                slot[l] = -1;
+        }
+    }
+    return slot;
+}
+
+} // namespace cache_probe_detail
+
+// mem-timing cache [--max-ws=bytes] [--profile=path]
+inline int RunCacheProbe(bench::Runner& runner, const DramGeometry& geo, int argc, char** argv) {
+    using namespace cache_probe_detail;
+    MachineProfile reported, sysfs;
+    reported.l3 = sysfs.l3 = MachineProfile::Cache{};
+    bool has_cpuid = MachineProfile::FromCpuid(reported);
+    bool has_sysfs = FromSysfs(sysfs);
+
+    const int64_t max_ws = ArgInt(argc, argv, "--max-ws=", std::max<int64_t>(256 * 1024 * 1024, reported.LastLevel().size * 4));
+    const char* profile_path = ArgValue(argc, argv, "--profile=");
+
+    auto buf = (uint8_t*)AlignedAlloc(max_ws, 1 << 21);
+    if (!buf) {
+        printf("%s", "out of memory.\n");
+        return 1;
+    }
+    AdviseHugePages(buf, max_ws);
+    for(int64_t i = 0; i < max_ws; i += 4096)
+        buf[i] = 0;
+
+    // sizes: random chase, two points per octave
+    printf("%s", "size sweep (random chase)\n");
+    std::vector<int64_t> ws;
+    std::vector<double> lat;
+    for(int64_t p = 4096; p <= max_ws; p *= 2) {
+        for(int64_t s: { p, p / 2 * 3 }) {
+            if (s > max_ws)
+                break;
+            ChaseConfig c;
+            c.working_set = s;
+            ws.push_back(s);
+            lat.push_back(ChaseLatency(runner, "cache size " + std::to_string(s), BuildChase(buf, c), s / 64));
+            printf("  %8lld KB: %6.2f ns\n", (long long)(s / 1024), lat.back());
+        }
+    }
+    auto levels = FindLevels(ws, lat);
+
+    // line size: a random 512 byte block, then the same block + d, then the next block
+    printf("%s", "line size (block, block + d pairs)\n");
+    std::vector<int64_t> dists = { 8, 16, 32, 64, 128, 256 };
+    std::vector<double> pair_lat;
+    {
+        const int64_t blocks = std::min<int64_t>(max_ws, 256 * 1024 * 1024) / 512;
+        std::vector<uint32_t> order((size_t)blocks);
+        for(int64_t i = 0; i < blocks; ++i)
+            order[i] = (uint32_t)i;
+        std::mt19937_64 mt(5);
+        std::shuffle(order.begin(), order.end(), mt);
+        for(auto d: dists) {
+            void** first = nullptr;
+            void** prev = nullptr;
+            for(auto b: order) {
+                auto a = (void**)(buf + (int64_t)b * 512);
+                auto c = (void**)(buf + (int64_t)b * 512 + d);
+                if (prev)
+                    *prev = a;
+                else
+                    first = a;
+                *a = c;
+                prev = c;
+            }
+            *prev = first;
+            pair_lat.push_back(ChaseLatency(runner, "cache line pair " + std::to_string(d), first, blocks * 2));
+            printf("  d = %3lld: %6.2f ns per load\n", (long long)d, pair_lat.back());
+        }
+    }
+    int64_t line_size = 0;
+    double mid = (pair_lat.front() + pair_lat.back()) / 2;
+    for(size_t i = 0; i < dists.size() && !line_size; ++i) {
+        if (pair_lat[i] > mid)
+            line_size = dists[i];
+    }
+
+    // associativity: n lines one cache size apart share a set, hits until n > ways
+    std::vector<int> ways;
+    for(size_t l = 0; l + 1 < levels.size() && l < 2; ++l) {
+        int64_t stride = PowerOfTwoBelow(levels[l].size);
+        // the next plateau may be memory when a level is hidden, twice the hit latency is a miss anyway
+        double threshold = std::min((levels[l].latency + levels[l + 1].latency) / 2, levels[l].latency * 2);
+        int w = 0;
+        printf("L%zu associativity (stride %lld KB):", l + 1, (long long)(stride / 1024));
+        for(int n = 2; n <= 32 && n * stride <= max_ws; ++n) {
+            for(int i = 0; i < n; ++i)
+                *(void**)(buf + i * stride) = buf + (i + 1) % n * stride;
+            double t = ChaseLatency(runner, "cache L" + std::to_string(l + 1) + " ways " + std::to_string(n), (void**)buf, n);
+            printf(" %d:%.1f", n, t);
+            if (t < threshold)
+                w = n;
+            else
+                break;
+        }
+        printf("%s", "\n");
+        ways.push_back(w);
+    }
+    AlignedFree(buf);
+
+    // measured, falling back to cpuid for whatever didn't show up
+    MachineProfile prof = reported;
+    prof.l3 = has_cpuid ? reported.l3 : MachineProfile().l3;
+    MachineProfile::Cache* slot[3] = { &prof.l1d, &prof.l2, &prof.l3 };
+    const MachineProfile defaults;
+    const MachineProfile& ref = has_cpuid ? reported : has_sysfs ? sysfs : defaults;
+    const MachineProfile::Cache* ref_slot[3] = { &ref.l1d, &ref.l2, &ref.l3 };
+    auto match = MatchLevels(levels, ref_slot);
+    for(size_t l = 0; l < match.size(); ++l) {
+        if (match[l] < 0) {
+            printf("plateau at %lld KB matches no reported level, left out\n", (long long)(levels[l].size / 1024));
+            continue;
+        }
+        auto s = slot[match[l]];
+        s->size = levels[l].size;
+        s->latency_ns = levels[l].latency;
+        if (l < ways.size() && ways[l])
+            s->ways = ways[l];
+    }
+    if (line_size)
+        prof.line_size = line_size;
+    prof.dram_rowsize = geo.rowsize;
+    prof.dram_channels = geo.mem_chs;
+    prof.source = "measured";
+
+    auto row = [&](const char* name, const MachineProfile::Cache& m, const MachineProfile::Cache& c, const MachineProfile::Cache& s) {
+        printf("%-6s | %9lld KB %3d-way %6.2f ns | %9lld KB %3d-way | %9lld KB %3d-way\n", name,
+            (long long)m.size / 1024, m.ways, m.latency_ns, (long long)c.size / 1024, c.ways, (long long)s.size / 1024, s.ways);
+    };
+    printf("%-6s | %-30s | %-20s | %-20s\n", "", "measured (effective)", has_cpuid ? "cpuid" : "cpuid n/a", has_sysfs ? "sysfs" : "sysfs n/a");
+    row("L1d", prof.l1d, reported.l1d, sysfs.l1d);
+    row("L2", prof.l2, reported.l2, sysfs.l2);
+    row("L3", prof.l3, reported.l3, sysfs.l3);
+    printf("%-6s | %9lld B %18s | %9lld B %8s | %9lld B\n", "line", (long long)prof.line_size, "", (long long)reported.line_size, "", (long long)sysfs.line_size);
+    printf("memory %.1f ns\n", levels.back().latency);
+    const auto matched = std::count_if(match.begin(), match.end(), [](int m) { return m >= 0; });
+    if (matched < 3)
+        printf("only %d cache levels showed up, the others are cpuid values\n", (int)matched);
+
+    std::string path = profile_path ? profile_path : "machine_profile.txt";
+    if (prof.Save(path, "written by mem-timing cache"))
+        printf("profile written to %s\n", path.c_str());
+    return 0;
+}
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+
+#include "bench_runner.h"
+#include "timing_common.h"
+#include "pointer_chase.h"
+#include "line_kernels.h"
+#include "topology.h"
+
+// memory latency seen from every core, idle and while the other cores stream
+//
+// the probe (a random chase over --ws) runs pinned to each physical core in turn (every cpu with
+// --smt); for the loaded column one thread per other physical core reads, writes or nt-writes its
+// own buffer sequentially until the probe is done. the probe buffer is first touched from the first cpu,
+// cores of other packages see the numa distance too.
+
+namespace core_map_detail {
+
+enum class Load { Read, Write, NtWrite };
+
+inline const char* LoadName(Load l) {
+    switch(l) {
+    case Load::Read: return "read";
+    case Load::Write: return "write";
+    case Load::NtWrite: return "nt write";
+    }
+    return "";
+}
+
+// background traffic on the given cpus while measure() runs
+template<class F>
+inline double UnderLoad(Load kind, const std::vector<int>& cpus, const std::vector<uint8_t*>& bufs, int64_t size, F measure) {
+    std::atomic<bool> stop{false};
+    std::atomic<int> ready{0};
+    std::vector<std::thread> t;
+    for(size_t i = 0; i < cpus.size(); ++i) {
+        t.emplace_back([&, i]() {
+            PinThread(cpus[i]);
+            uint64_t sink = 0;
+            for(bool first = true; first || !stop; first = false) { // the first pass before the probe starts
+                if (kind == Load::Read) {
+                    sink ^= ReadLines(LineOrder::RowSeqLineSeq, bufs[i], size, size);
+                } else if (kind == Load::Write) {
+                    LineWrite<false> w;
+                    VisitLines(LineOrder::RowSeqLineSeq, w, bufs[i], size, size);
+                } else {
+                    LineWrite<true> w;
+                    VisitLines(LineOrder::RowSeqLineSeq, w, bufs[i], size, size);
+                    w.Done();
+                }
+                if (first)
+                    ++ready;
+            }
+            volatile uint64_t keep = sink;
+            (void)keep;
+        });
+    }
+    while(ready < (int)cpus.size())
+        std::this_thread::yield();
+    double r = measure();
+    stop = true;
+    for(auto& th: t)
+        th.join();
+    return r;
+}
+
+} // namespace core_map_detail
+
+// mem-timing coremap [--ws=bytes] [--load=read|write|nt] [--load-ws=bytes] [--smt]
+inline int RunCoreMap(bench::Runner& runner, int argc, char** argv) {
+    using namespace core_map_detail;
+    const int64_t ws = ArgInt(argc, argv, "--ws=", 256 * 1024 * 1024);
+    const int64_t load_ws = ArgInt(argc, argv, "--load-ws=", 64 * 1024 * 1024) / 4096 * 4096;
+    Load kind = Load::Read;
+    if (auto v = ArgValue(argc, argv, "--load=")) {
+        std::string s = v;
+        kind = s == "write" ? Load::Write : s == "nt" ? Load::NtWrite : Load::Read;
+    }
+    bool smt = false;
+    for(int i = 1; i < argc; ++i)
+        smt |= strcmp(argv[i], "--smt") == 0;
+
+    // one cpu per physical core streams, the probe runs there too, or on every cpu with --smt
+    auto topo = CpuTopology();
+    std::vector<CpuInfo> cores, probes;
+    for(auto& c: topo) {
+        if (std::none_of(cores.begin(), cores.end(), [&](const CpuInfo& x) { return x.package == c.package && x.core == c.core; }))
+            cores.push_back(c);
+    }
+    probes = smt ? topo : cores;
+
+    PinThread(topo[0].cpu);
+    auto buf = (uint8_t*)AlignedAlloc(ws, 1 << 21);
+    std::vector<uint8_t*> load_bufs;
+    for(size_t i = 0; buf && i < cores.size(); ++i) {
+        load_bufs.push_back((uint8_t*)AlignedAlloc(load_ws, 1 << 21));
+        if (!load_bufs.back())
+            break;
+    }
+    if (!buf || (!load_bufs.empty() && !load_bufs.back())) {
+        printf("%s", "out of memory.\n");
+        return 1;
+    }
+    AdviseHugePages(buf, ws);
+    ChaseConfig c;
+    c.working_set = ws;
+    void** p = BuildChase(buf, c);
+    const int64_t steps = std::max<int64_t>(ws / 64, 1 << 20) / 8 * 8;
+
+    printf("%zu probe cpus, background: %s on the %zu other cores, %lld MB each, %s\n", probes.size(), LoadName(kind),
+        cores.size() - 1, (long long)(load_ws >> 20), LineKernelIsa());
+    printf("%5s | %7s | %4s | %7s | %10s | %10s | %6s\n", "cpu", "package", "core", "cluster", "idle ns", "loaded ns", "x");
+    std::vector<double> idle(probes.size()), loaded(probes.size());
+    for(size_t i = 0; i < probes.size(); ++i) {
+        const int cpu = probes[i].cpu;
+        // every other physical core streams, its own buffer (first touched by that thread's pass)
+        std::vector<int> others;
+        std::vector<uint8_t*> bufs;
+        for(size_t j = 0; j < cores.size(); ++j) {
+            if (cores[j].package != probes[i].package || cores[j].core != probes[i].core) {
+                others.push_back(cores[j].cpu);
+                bufs.push_back(load_bufs[j]);
+            }
+        }
+        auto probe = [&]() {
+            PinThread(cpu);
+            p = Chase(p, steps / 4); // warm the tlb on this core
+            auto samples = bench::Collect(runner.options(), [&]() {
+                StopWatch w;
+                p = Chase(p, steps);
+                return (double)w.cost_ns() / steps;
+            });
+            return samples;
+        };
+        std::string name = "coremap cpu " + std::to_string(cpu);
+        idle[i] = runner.Add(name + " idle", "ns", probe(), false).stats.median;
+        loaded[i] = UnderLoad(kind, others, bufs, load_ws, [&]() {
+            return runner.Add(name + " loaded", "ns", probe(), false).stats.median;
+        });
+        printf("%5d | %7d | %4d | %7d | %10.1f | %10.1f | %5.2fx\n", cpu, probes[i].package, probes[i].core, probes[i].cluster,
+            idle[i], loaded[i], loaded[i] / idle[i]);
+        fflush(stdout);
+    }
+
+    // per cluster (cpus sharing the llc): mean, and the best and worst core
+    int clusters = 0;
+    for(auto& pr: probes)
+        clusters = std::max(clusters, pr.cluster + 1);
+    printf("\n%7s | %4s | %10s | %10s | %16s | %16s\n", "cluster", "cpus", "idle ns", "loaded ns", "best cpu loaded", "worst cpu loaded");
+    for(int k = 0; k < clusters; ++k) {
+        double si = 0, sl = 0;
+        int n = 0;
+        size_t best = 0, worst = 0;
+        for(size_t i = 0; i < probes.size(); ++i) {
+            if (probes[i].cluster != k)
+                continue;
+            if (n == 0 || loaded[i] < loaded[best])
+                best = i;
+            if (n == 0 || loaded[i] > loaded[worst])
+                worst = i;
+            si += idle[i];
+            sl += loaded[i];
+            ++n;
+        }
+        if (n == 0)
+            continue;
+        printf("%7d | %4d | %10.1f | %10.1f | %5d %8.1f ns | %5d %8.1f ns\n", k, n, si / n, sl / n, probes[best].cpu, loaded[best],
+            probes[worst].cpu, loaded[worst]);
+    }
+
+    volatile uintptr_t sink = (uintptr_t)p;
+    (void)sink;
+    for(auto b: load_bufs)
+        AlignedFree(b);
+    AlignedFree(buf);
+    return 0;
+}
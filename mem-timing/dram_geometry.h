@@ -0,0 +1,303 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstdio>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iterator>
+#include <algorithm>
+#include <random>
+#include <thread>
+#include <atomic>
+
+#ifdef __linux__
+#include <dirent.h>
+#endif
+
+#include "bench_runner.h"
+#include "timing_common.h"
+
+// what the memory looks like from this process
+// defaults are the values this tool used to hardcode (i9-13900HX, DDR5 5600 from HWiNFO)
+struct DramGeometry {
+    int64_t freq = 2600;                // MHz, memory clock = MT/s / 2
+    int64_t mem_chs = 4;                // 2 channels per dimm, 2 dimm
+    int64_t mem_ch_size = 8;            // bytes, channel width
+    int64_t rowsize = (1 << 10) * 64;   // effective row-buffer span seen from the virtual address space
+    int64_t interleave = 0;             // channel interleave granularity, 0 = not detected
+    int64_t tCL = 42;
+    int64_t tRCD = 42;
+    int64_t tRP = 42;
+    int64_t tRAS = 82;
+
+    // where each group came from: "default", "dmi", "spd", "timing", "command line"
+    std::string freq_from = "default";
+    std::string channels_from = "default";
+    std::string rowsize_from = "default";
+    std::string timings_from = "default";
+
+    void Print() const {
+        printf("memory clock: %lld MHz (%s)\n", (long long)freq, freq_from.c_str());
+        printf("channels: %lld x %lld bytes (%s)\n", (long long)mem_chs, (long long)mem_ch_size, channels_from.c_str());
+        if (interleave)
+            printf("channel interleave: %lld bytes (timing)\n", (long long)interleave);
+        printf("row-buffer span: %lld bytes (%s)\n", (long long)rowsize, rowsize_from.c_str());
+        printf("tCL-tRCD-tRP-tRAS: %lld-%lld-%lld-%lld (%s)\n",
+            (long long)tCL, (long long)tRCD, (long long)tRP, (long long)tRAS, timings_from.c_str());
+    }
+};
+
+namespace dram_detail {
+
+inline bool ReadFile(const std::string& path, std::vector<uint8_t>& out) {
+    std::ifstream f(path, std::ios::binary);
+    if (!f)
+        return false;
+    out.assign(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+    return !out.empty();
+}
+
+inline uint16_t Word(const std::vector<uint8_t>& b, size_t off) {
+    return off + 1 < b.size() ? (uint16_t)(b[off] | (b[off + 1] << 8)) : 0;
+}
+
+inline std::vector<std::string> ListDir(const std::string& dir, const std::string& prefix) {
+    std::vector<std::string> names;
+#ifdef __linux__
+    if (DIR* d = opendir(dir.c_str())) {
+        while(dirent* e = readdir(d)) {
+            std::string n = e->d_name;
+            if (n.compare(0, prefix.size(), prefix) == 0)
+                names.push_back(n);
+        }
+        closedir(d);
+    }
+    std::sort(names.begin(), names.end());
+#endif
+    return names;
+}
+
+} // namespace dram_detail
+
+// smbios type 17 (memory device), /sys/firmware/dmi is root only on most distros
+inline bool ReadDmi(DramGeometry& g) {
+    using namespace dram_detail;
+    int dimms = 0;
+    int type = 0;
+    int width = 0;
+    int speed = 0;
+    for(auto& name: ListDir("/sys/firmware/dmi/entries", "17-")) {
+        std::vector<uint8_t> raw;
+        if (!ReadFile("/sys/firmware/dmi/entries/" + name + "/raw", raw) || raw.size() < 0x17)
+            continue;
+        uint16_t size = Word(raw, 0x0C);
+        if (size == 0 || size == 0xFFFF)
+            continue; // empty slot
+        ++dimms;
+        type = raw[0x12];
+        width = Word(raw, 0x0A);
+        int configured = raw[1] >= 0x22 ? Word(raw, 0x20) : 0;
+        speed = configured ? configured : Word(raw, 0x15);
+    }
+    if (dimms == 0)
+        return false;
+
+    // ddr5 and lpddr5 dimms carry two 32bit sub-channels
+    bool ddr5 = type == 0x22 || type == 0x23;
+    g.mem_chs = ddr5 ? dimms * 2 : dimms;
+    g.mem_ch_size = ddr5 ? 4 : std::max(1, width / 8);
+    g.channels_from = "dmi";
+    if (speed) {
+        g.freq = speed / 2;
+        g.freq_from = "dmi";
+    }
+    return true;
+}
+
+// jedec minimum timings from the spd eeprom (ee1004 for ddr4, spd5118 for ddr5), in clocks of g.freq
+inline bool ReadSpd(DramGeometry& g) {
+    using namespace dram_detail;
+    for(auto driver: { "ee1004", "spd5118" }) {
+        std::string dir = std::string("/sys/bus/i2c/drivers/") + driver;
+        for(auto& dev: ListDir(dir, "")) {
+            std::vector<uint8_t> spd;
+            if (dev[0] == '.' || !ReadFile(dir + "/" + dev + "/eeprom", spd) || spd.size() < 128)
+                continue;
+            double tck, taa, trcd, trp, tras; // ps
+            if (spd[2] == 0x0C) { // ddr4: 125ps medium timebase + signed 1ps fine correction
+                auto mtb = [&](int coarse, int fine) { return spd[coarse] * 125.0 + (int8_t)spd[fine]; };
+                tck = mtb(18, 125);
+                taa = mtb(24, 123);
+                trcd = mtb(25, 122);
+                trp = mtb(26, 121);
+                tras = (((spd[27] & 0x0F) << 8) | spd[28]) * 125.0;
+            } else if (spd[2] == 0x12) { // ddr5: plain ps
+                tck = Word(spd, 20);
+                taa = Word(spd, 30);
+                trcd = Word(spd, 32);
+                trp = Word(spd, 34);
+                tras = Word(spd, 36);
+            } else {
+                continue;
+            }
+            if (g.freq_from == "default" && tck > 0) {
+                g.freq = (int64_t)std::llround(1e6 / tck);
+                g.freq_from = "spd";
+            }
+            double clk = 1e6 / g.freq; // ps per clock at the running speed
+            auto clocks = [&](double t) { return (int64_t)std::ceil(t / clk - 0.01); };
+            g.tCL = clocks(taa);
+            g.tRCD = clocks(trcd);
+            g.tRP = clocks(trp);
+            g.tRAS = clocks(tras);
+            g.timings_from = "spd";
+            return true;
+        }
+    }
+    return false;
+}
+
+// latency of reading b right after a, both flushed: low while b = a + d stays in the row a opened
+// the span is where the latency has done 90% of the rise from the shortest to the longest distances
+// a and b are in the same `page` (physically contiguous), d goes up to half of it
+inline int64_t DetectRowSize(bench::Runner& runner, uint8_t* buf, int64_t bufsize, int64_t page) {
+    std::mt19937_64 mt(1);
+    std::vector<int64_t> dists;
+    std::vector<double> latency;
+    const int64_t pages = bufsize / page;
+    for(int64_t d = 256; d * 2 <= page; d *= 2) {
+        auto samples = bench::Collect(runner.options(), [&]() {
+            const int pairs = 2000;
+            volatile uint64_t sink = 0;
+            volatile uint64_t zero = 0; // the compiler can't fold it, b stays dependent on a
+            StopWatch w;
+            for(int i = 0; i < pairs; ++i) {
+                auto a = buf + (int64_t)(mt() % pages) * page + (mt() % (page - d)) / 64 * 64;
+                auto b = a + d;
+                FlushLine(a);
+                FlushLine(b);
+                FullFence();
+                uint64_t x = *(volatile uint64_t*)a;
+                sink += *(volatile uint64_t*)(b + (x & zero));
+            }
+            return (double)w.cost_ns() / pairs;
+        });
+        auto& r = runner.Add("row sweep " + std::to_string(d), "ns/pair", samples, false);
+        dists.push_back(d);
+        latency.push_back(r.stats.median);
+        printf("  a, a + %8lld: %6.1f ns\n", (long long)d, r.stats.median);
+    }
+    if (latency.size() < 6)
+        return 0;
+    auto median3 = [](double a, double b, double c) { return std::max(std::min(a, b), std::min(std::max(a, b), c)); };
+    double lo = median3(latency[0], latency[1], latency[2]);
+    size_t n = latency.size();
+    double hi = median3(latency[n - 3], latency[n - 2], latency[n - 1]);
+    if (hi < lo * 1.1)
+        return 0; // no visible step, noise or the mapping hides it
+    for(size_t i = 0; i < n; ++i) {
+        if (latency[i] >= lo + (hi - lo) * 0.9)
+            return dists[i];
+    }
+    return 0;
+}
+
+// read a chunk of g bytes every k * g bytes with all cores, bytes actually read per second
+inline double StridedBandwidth(uint8_t* buf, int64_t bufsize, int64_t g, int64_t k) {
+    int threads = std::max(1u, std::thread::hardware_concurrency());
+    int64_t period = g * k;
+    int64_t periods = bufsize / period;
+    std::atomic<uint64_t> sink{0};
+    std::vector<std::thread> t;
+    StopWatch w;
+    for(int i = 0; i < threads; ++i) {
+        t.emplace_back([&, i]() {
+            uint64_t sum = 0;
+            for(int64_t p = i * periods / threads; p < (i + 1) * periods / threads; ++p) {
+                auto chunk = buf + p * period;
+                for(int64_t off = 0; off < g; off += 64)
+                    sum += *(const uint64_t*)(chunk + off);
+            }
+            sink += sum;
+        });
+    }
+    for(auto& th: t)
+        th.join();
+    return periods * g / (w.cost_ns() / 1e9);
+}
+
+// reading every other g-chunk halves the bandwidth once a chunk is a whole interleave unit
+// then at that granularity, keep spreading the chunks until only one channel is left
+inline bool DetectInterleave(bench::Runner& runner, DramGeometry& geo, uint8_t* buf, int64_t bufsize) {
+    if (std::thread::hardware_concurrency() < 4)
+        printf("%s", "  warning: too few cores to saturate memory, the result is unreliable\n");
+    auto bw = [&](int64_t g, int64_t k) {
+        auto samples = bench::Collect(runner.options(), [&]() { return StridedBandwidth(buf, bufsize, g, k) / 1048576.0; });
+        return runner.Add("interleave sweep " + std::to_string(g) + " x" + std::to_string(k), "MB/S", samples, false).stats.median;
+    };
+
+    // below 256 bytes the adjacent line and streamer prefetchers read the skipped chunks anyway
+    int64_t granularity = 0;
+    for(int64_t g = 256; g <= 64 * 1024; g *= 2) {
+        double r = bw(g, 2) / bw(g, 1);
+        printf("  %6lld bytes every %6lld: %.2f of sequential\n", (long long)g, (long long)g * 2, r);
+        if (r < 0.75) {
+            granularity = g;
+            break;
+        }
+    }
+    if (!granularity)
+        return false;
+    geo.interleave = granularity;
+
+    double base = bw(granularity, 1);
+    double prev = bw(granularity, 2) / base;
+    int64_t channels = 2;
+    for(int64_t k = 4; k <= 32; k *= 2) {
+        double r = bw(granularity, k) / base;
+        printf("  %6lld bytes every %6lld: %.2f of sequential\n", (long long)granularity, (long long)(granularity * k), r);
+        if (r > prev * 0.8)
+            break; // plateau, a single channel already
+        prev = r;
+        channels = k;
+    }
+    geo.mem_chs = channels;
+    geo.channels_from = "timing";
+    return true;
+}
+
+// dmi / spd first, then timing sweeps over a scratch buffer for what they can't tell
+inline DramGeometry DetectDramGeometry(bench::Runner& runner, bool sweep_channels) {
+    DramGeometry geo;
+    ReadDmi(geo);
+    ReadSpd(geo);
+
+    const int64_t bufsize = 512 * 1024 * 1024;
+    auto buf = (uint8_t*)AlignedAlloc(bufsize, 1 << 21);
+    if (!buf)
+        return geo;
+    AdviseHugePages(buf, bufsize);
+    for(int64_t i = 0; i < bufsize; i += 4096)
+        buf[i] = 0;
+
+    // on 4K pages a + d is another, unrelated frame and the step would be the page size
+    const int64_t huge_page = 2 * 1024 * 1024;
+    if (HugePageBytes(buf, bufsize) >= (size_t)bufsize / 10 * 9) {
+        printf("%s", "row-buffer sweep\n");
+        if (auto row = DetectRowSize(runner, buf, bufsize, huge_page)) {
+            geo.rowsize = row;
+            geo.rowsize_from = "timing";
+        }
+    } else {
+        printf("row-buffer sweep skipped: the buffer isn't on huge pages (THP off?), keeping the %s row size\n", geo.rowsize_from.c_str());
+    }
+    if (sweep_channels && geo.channels_from == "default") {
+        printf("%s", "channel interleave sweep\n");
+        DetectInterleave(runner, geo, buf, bufsize);
+    }
+
+    AlignedFree(buf);
+    return geo;
+}
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+#include "bench_runner.h"
+#include "timing_common.h"
+#include "dram_geometry.h"
+#include "pointer_chase.h"
+#include "latency_hist.h"
+#include "tsc.h"
+
+// first order latency model from the dram timings, against the dependent chase orders
+//
+//   row hit        tCL
+//   row empty      tRCD + tCL
+//   row conflict   tRP + tRCD + tCL, at least tRAS + tRP after the previous activate of the bank
+//
+// plus a fixed controller / fabric / cache lookup overhead: a same row pair measured with the
+// tsc, minus tCL. the row-buffer outcome of every access in a chase comes from replaying the
+// chase over one open row per bank, bank = row span index % banks.
+// efficiency = predicted / measured: above 1 prefetchers / overlap beat the model, below 1
+// something the model doesn't know about costs time (tlb walks, refresh, a closed page policy).
+
+struct DramModel {
+    double tck = 0;         // ns per memory clock
+    double overhead = 0;    // ns on top of the dram timings
+    double hit = 0, empty = 0, conflict = 0, cycle = 0; // ns, dram part only; cycle = tRAS + tRP
+
+    static DramModel From(const DramGeometry& geo, double overhead) {
+        DramModel m;
+        m.tck = 1000.0 / geo.freq;
+        m.overhead = overhead;
+        m.hit = geo.tCL * m.tck;
+        m.empty = (geo.tRCD + geo.tCL) * m.tck;
+        m.conflict = (geo.tRP + geo.tRCD + geo.tCL) * m.tck;
+        m.cycle = (geo.tRAS + geo.tRP) * m.tck;
+        return m;
+    }
+};
+
+namespace dram_model_detail {
+
+struct Outcome {
+    double hit = 0, empty = 0, conflict = 0; // fractions
+    double ns = 0;                           // predicted per access
+};
+
+// replays up to `steps` links of the chase, one open row per bank
+inline Outcome Replay(const DramModel& m, void** first, const uint8_t* buf, int64_t rowsize, int64_t banks, int64_t steps) {
+    std::vector<int64_t> open((size_t)banks, -1);
+    int64_t hits = 0, empties = 0, conflicts = 0;
+    int64_t last_bank = -1;
+    double dram = 0;
+    void** p = first;
+    for(int64_t i = 0; i < steps; ++i) {
+        int64_t row = ((const uint8_t*)p - buf) / rowsize;
+        int64_t bank = row % banks;
+        if (open[bank] == row) {
+            ++hits;
+            dram += m.hit;
+        } else if (open[bank] < 0) {
+            ++empties;
+            dram += m.empty;
+        } else {
+            ++conflicts;
+            // back to back activates of one bank are tRC apart, the load waited for the previous one
+            dram += bank == last_bank ? std::max(m.conflict, m.cycle) : m.conflict;
+        }
+        open[bank] = row;
+        last_bank = bank;
+        p = (void**)*p;
+        if (p == first)
+            steps = i + 1;
+    }
+    Outcome o;
+    o.hit = (double)hits / steps;
+    o.empty = (double)empties / steps;
+    o.conflict = (double)conflicts / steps;
+    o.ns = m.overhead + dram / steps;
+    return o;
+}
+
+} // namespace dram_model_detail
+
+// mem-timing model [--ws=bytes] [--banks=n] [--samples=n]
+inline int RunDramModel(bench::Runner& runner, const DramGeometry& geo, int argc, char** argv) {
+    using namespace dram_model_detail;
+    const int64_t ws = ArgInt(argc, argv, "--ws=", 1024 * 1024 * 1024);
+    const int64_t banks = std::max<int64_t>(ArgInt(argc, argv, "--banks=", geo.mem_chs * 16), 1);
+    const int64_t samples = ArgInt(argc, argv, "--samples=", 50000);
+
+    auto buf = (uint8_t*)AlignedAlloc(ws, 1 << 21);
+    if (!buf) {
+        printf("%s", "out of memory.\n");
+        return 1;
+    }
+    AdviseHugePages(buf, ws);
+    for(int64_t i = 0; i < ws; i += 4096)
+        buf[i] = 0;
+
+    // calibration: same row pairs give the overhead, random pairs and lone lines are the check
+    auto clock = TscClock::Calibrate();
+    std::mt19937_64 mt(7);
+    auto pick = [&]() { return buf + (mt() % (uint64_t)ws) / 256 * 256; };
+    std::vector<double> same_row, random_pair, lone;
+    for(int64_t i = 0; i < samples; ++i) {
+        auto a = pick();
+        same_row.push_back(clock.ns(latency_hist_detail::TimedPair(a, a + 128)));
+        random_pair.push_back(clock.ns(latency_hist_detail::TimedPair(pick(), pick())));
+        lone.push_back(clock.ns(latency_hist_detail::TimedSingle(pick())));
+    }
+    double hit_measured = runner.Add("model same row pair", "ns", same_row, false).stats.median;
+    double random_measured = runner.Add("model random pair", "ns", random_pair, false).stats.median;
+    double lone_measured = runner.Add("model flushed line", "ns", lone, false).stats.median;
+
+    auto m = DramModel::From(geo, 0);
+    m.overhead = hit_measured - m.hit;
+    if (m.overhead < 0) {
+        printf("same row pair %.1f ns is below tCL %.1f ns, timings too slow for this machine (%s)\n",
+            hit_measured, m.hit, geo.timings_from.c_str());
+        m.overhead = 0;
+    }
+    printf("tCK %.3f ns, %lld banks, dram part: hit %.1f, empty %.1f, conflict %.1f, tRAS + tRP %.1f ns\n",
+        m.tck, (long long)banks, m.hit, m.empty, m.conflict, m.cycle);
+    printf("controller overhead %.1f ns (same row pair %.1f ns - tCL)\n", m.overhead, hit_measured);
+    printf("random pair %.1f ns, flushed line %.1f ns: model row empty %.1f, row conflict %.1f ns\n",
+        random_measured, lone_measured, m.overhead + m.empty, m.overhead + m.conflict);
+
+    std::vector<ChaseOrder> orders = {
+        ChaseOrder::RowSeqLineSeq, ChaseOrder::RowSeqLineJump, ChaseOrder::RowRevLineSeq,
+        ChaseOrder::RowRevLineJump, ChaseOrder::LineSeqRowJump, ChaseOrder::Random,
+    };
+    printf("%-24s | %6s %6s %6s | %10s | %10s | %10s\n", "order", "hit", "empty", "confl", "predicted", "measured", "efficiency");
+    for(auto o: orders) {
+        ChaseConfig c;
+        c.order = o;
+        c.working_set = ws;
+        c.rowsize = geo.rowsize;
+        auto out = Replay(m, BuildChase(buf, c), buf, geo.rowsize, banks, 1 << 22);
+        double measured = runner.Add(std::string("model chase ") + ChaseOrderName(o), "ns", MeasureChase(runner, buf, c), false).stats.median;
+        printf("%-24s | %5.1f%% %5.1f%% %5.1f%% | %7.1f ns | %7.1f ns | %10.2f\n", ChaseOrderName(o),
+            out.hit * 100, out.empty * 100, out.conflict * 100, out.ns, measured, out.ns / measured);
+        fflush(stdout);
+    }
+
+    AlignedFree(buf);
+    return 0;
+}
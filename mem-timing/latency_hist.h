@@ -0,0 +1,141 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+#include "bench_runner.h"
+#include "timing_common.h"
+#include "dram_geometry.h"
+#include "tsc.h"
+
+// per access latency: every sample is one flushed load between tsc reads
+//
+//   flushed line      the load alone
+//   same row          a, then a + 128 (same 256 byte block: same channel, same row), b timed
+//   random pair       a, then a random b: mostly row miss, row conflict when b shares a's bank
+//
+// the random pair population is split with the same row population as the hit bound and the
+// deepest valley between the two main peaks above it as the conflict bound
+
+namespace latency_hist_detail {
+
+// a is loaded and completed first (lfence waits for it), then b is timed
+inline uint64_t TimedPair(const uint8_t* a, const uint8_t* b) {
+    FlushLine(a);
+    FlushLine(b);
+    FullFence();
+    *(volatile const uint64_t*)a;
+    _mm_lfence();
+    uint64_t t0 = TscBegin();
+    *(volatile const uint64_t*)b;
+    return TscEnd() - t0;
+}
+
+inline uint64_t TimedSingle(const uint8_t* a) {
+    FlushLine(a);
+    FullFence();
+    uint64_t t0 = TscBegin();
+    *(volatile const uint64_t*)a;
+    return TscEnd() - t0;
+}
+
+// lowest smoothed bucket between the two highest smoothed peaks at or above `from`, 0 if single peak
+inline double Valley(const Histogram& h, double from, size_t min_peak) {
+    size_t n = h.Buckets();
+    std::vector<double> s(n);
+    for(size_t i = 0; i < n; ++i)
+        s[i] = (h.Count(i ? i - 1 : i) + h.Count(i) + h.Count(std::min(i + 1, n - 1))) / 3.0;
+    std::vector<size_t> peaks;
+    for(size_t i = 1; i + 1 < n; ++i) {
+        if (h.Lower(i) >= from && s[i] >= min_peak && s[i] > s[i - 1] && s[i] >= s[i + 1])
+            peaks.push_back(i);
+    }
+    if (peaks.size() < 2)
+        return 0;
+    std::sort(peaks.begin(), peaks.end(), [&](size_t a, size_t b) { return s[a] > s[b]; });
+    size_t p0 = std::min(peaks[0], peaks[1]), p1 = std::max(peaks[0], peaks[1]);
+    size_t v = std::min_element(s.begin() + p0, s.begin() + p1 + 1) - s.begin();
+    return h.Lower(v + 1);
+}
+
+} // namespace latency_hist_detail
+
+// mem-timing hist [--samples=n] [--ws=bytes] [--buckets=n]
+inline int RunLatencyHist(bench::Runner& runner, const DramGeometry& geo, int argc, char** argv) {
+    using namespace latency_hist_detail;
+    const int64_t samples = ArgInt(argc, argv, "--samples=", 200000);
+    const int64_t ws = ArgInt(argc, argv, "--ws=", 1024 * 1024 * 1024);
+    const int buckets = (int)ArgInt(argc, argv, "--buckets=", 48);
+
+    auto buf = (uint8_t*)AlignedAlloc(ws, 1 << 21);
+    if (!buf) {
+        printf("%s", "out of memory.\n");
+        return 1;
+    }
+    AdviseHugePages(buf, ws);
+    for(int64_t i = 0; i < ws; i += 4096)
+        buf[i] = 0;
+
+    if (!InvariantTsc())
+        printf("%s", "warning: no invariant tsc, the tick rate follows the core clock\n");
+    auto clock = TscClock::Calibrate();
+    printf("tsc %.3f GHz, timer overhead %llu ticks (subtracted)\n", clock.ghz, (unsigned long long)clock.overhead);
+
+    struct Population {
+        const char* name;
+        std::vector<double> ns;
+    };
+    std::vector<Population> pops = { { "flushed line", {} }, { "same row", {} }, { "random pair", {} } };
+    std::mt19937_64 mt(3);
+    auto pick = [&]() { return buf + (mt() % (uint64_t)ws) / 256 * 256; };
+    for(int64_t i = 0; i < samples; ++i) {
+        pops[0].ns.push_back(clock.ns(TimedSingle(pick())));
+        auto a = pick();
+        pops[1].ns.push_back(clock.ns(TimedPair(a, a + 128)));
+        pops[2].ns.push_back(clock.ns(TimedPair(pick(), pick())));
+    }
+
+    std::vector<double> all;
+    for(auto& p: pops)
+        all.insert(all.end(), p.ns.begin(), p.ns.end());
+    std::sort(all.begin(), all.end());
+    double lo = bench::Percentile(all, 0.002), hi = bench::Percentile(all, 0.998);
+    hi = std::max(hi, lo + buckets);
+
+    std::vector<Histogram> hists;
+    for(auto& p: pops) {
+        Histogram h(lo, hi, buckets);
+        for(auto v: p.ns)
+            h.Add(v);
+        runner.Add("hist " + std::string(p.name), "ns", p.ns, false);
+        std::sort(p.ns.begin(), p.ns.end());
+        printf("%s: p50 %.1f, p90 %.1f, p99 %.1f, p99.9 %.1f ns\n", p.name, bench::Percentile(p.ns, 0.5),
+            bench::Percentile(p.ns, 0.9), bench::Percentile(p.ns, 0.99), bench::Percentile(p.ns, 0.999));
+        h.Print("ns");
+        hists.push_back(h);
+    }
+
+    // random pairs: hit up to the same row p90, conflict above the valley
+    double hit_bound = bench::Percentile(pops[1].ns, 0.9);
+    double conflict_bound = Valley(hists[2], hit_bound, (size_t)(samples / 200));
+    auto& rnd = pops[2].ns;
+    auto count_below = [&](double v) { return (size_t)(std::lower_bound(rnd.begin(), rnd.end(), v) - rnd.begin()); };
+    auto median_of = [&](size_t b, size_t e) { return b < e ? rnd[(b + e) / 2] : 0.0; };
+    size_t hits = count_below(hit_bound);
+    size_t misses = conflict_bound > 0 ? count_below(conflict_bound) : rnd.size();
+    printf("random pair, row span %lld bytes:\n", (long long)geo.rowsize);
+    printf("  row hit      (< %6.1f ns): %5.2f%%, median %.1f ns\n", hit_bound, 100.0 * hits / rnd.size(), median_of(0, hits));
+    if (conflict_bound > 0) {
+        printf("  row miss     (< %6.1f ns): %5.2f%%, median %.1f ns\n", conflict_bound, 100.0 * (misses - hits) / rnd.size(), median_of(hits, misses));
+        printf("  row conflict (>= %5.1f ns): %5.2f%%, median %.1f ns\n", conflict_bound, 100.0 * (rnd.size() - misses) / rnd.size(), median_of(misses, rnd.size()));
+    } else {
+        printf("  row miss / conflict: %5.2f%%, median %.1f ns (one peak, conflicts not separable)\n", 100.0 * (rnd.size() - hits) / rnd.size(), median_of(hits, rnd.size()));
+    }
+
+    AlignedFree(buf);
+    return 0;
+}
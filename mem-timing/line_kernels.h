@@ -0,0 +1,227 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "timing_common.h"
+
+// traversal kernels for the patterns mode: whole cache line loads, xor folded, so a line costs
+// one or two loads and the memory system is the bottleneck, not a per byte add. the same orders
+// drive whole line stores for the write patterns
+//
+// a line is two 32 byte halves. "cacheline seq" reads both halves of a line before the next,
+// "cacheline jump" reads the first half of every line in the row, then the second half,
+// "cacheline skip" reads the first half only. with avx-512 a whole line is one load.
+
+struct LineAcc {
+#if defined(__AVX2__)
+    __m256i v = _mm256_setzero_si256();
+
+    void Half(const uint8_t* p) {
+        v = _mm256_xor_si256(v, _mm256_load_si256((const __m256i*)p));
+    }
+#if defined(__AVX512F__)
+    __m512i w = _mm512_setzero_si512();
+
+    void Line(const uint8_t* p) {
+        w = _mm512_xor_si512(w, _mm512_load_si512(p));
+    }
+
+    uint64_t Fold() const {
+        __m256i x = _mm256_xor_si256(v, _mm256_xor_si256(_mm512_castsi512_si256(w), _mm512_extracti64x4_epi64(w, 1)));
+        return (uint64_t)(_mm256_extract_epi64(x, 0) ^ _mm256_extract_epi64(x, 1) ^ _mm256_extract_epi64(x, 2) ^ _mm256_extract_epi64(x, 3));
+    }
+#else
+    __m256i v2 = _mm256_setzero_si256(); // second halves, two independent xor chains
+
+    void Line(const uint8_t* p) {
+        Half(p);
+        v2 = _mm256_xor_si256(v2, _mm256_load_si256((const __m256i*)(p + 32)));
+    }
+
+    uint64_t Fold() const {
+        __m256i x = _mm256_xor_si256(v, v2);
+        return (uint64_t)(_mm256_extract_epi64(x, 0) ^ _mm256_extract_epi64(x, 1) ^ _mm256_extract_epi64(x, 2) ^ _mm256_extract_epi64(x, 3));
+    }
+#endif
+#else
+    // sse2: two 16 byte loads per half
+    __m128i v = _mm_setzero_si128();
+
+    void Half(const uint8_t* p) {
+        v = _mm_xor_si128(v, _mm_xor_si128(_mm_load_si128((const __m128i*)p), _mm_load_si128((const __m128i*)(p + 16))));
+    }
+
+    void Line(const uint8_t* p) {
+        Half(p);
+        Half(p + 32);
+    }
+
+    uint64_t Fold() const {
+        return (uint64_t)_mm_cvtsi128_si64(v) ^ (uint64_t)_mm_cvtsi128_si64(_mm_unpackhi_epi64(v, v));
+    }
+#endif
+};
+
+// stores of a fixed pattern: temporal (the line is read for ownership first) or non-temporal
+// (write combining, no read), Done() orders the non-temporal ones
+template<bool NonTemporal>
+struct LineWrite {
+#if defined(__AVX2__)
+    __m256i v = _mm256_set1_epi8(0x5a);
+
+    void Half(uint8_t* p) {
+        if constexpr (NonTemporal)
+            _mm256_stream_si256((__m256i*)p, v);
+        else
+            _mm256_store_si256((__m256i*)p, v);
+    }
+#if defined(__AVX512F__)
+    void Line(uint8_t* p) {
+        __m512i w = _mm512_broadcast_i64x4(v);
+        if constexpr (NonTemporal)
+            _mm512_stream_si512((__m512i*)p, w);
+        else
+            _mm512_store_si512(p, w);
+    }
+#else
+    void Line(uint8_t* p) {
+        Half(p);
+        Half(p + 32);
+    }
+#endif
+#else
+    __m128i v = _mm_set1_epi8(0x5a);
+
+    void Half(uint8_t* p) {
+        if constexpr (NonTemporal) {
+            _mm_stream_si128((__m128i*)p, v);
+            _mm_stream_si128((__m128i*)(p + 16), v);
+        } else {
+            _mm_store_si128((__m128i*)p, v);
+            _mm_store_si128((__m128i*)(p + 16), v);
+        }
+    }
+
+    void Line(uint8_t* p) {
+        Half(p);
+        Half(p + 32);
+    }
+#endif
+
+    void Done() {
+        if constexpr (NonTemporal)
+            _mm_sfence();
+    }
+};
+
+inline const char* LineKernelIsa() {
+#if defined(__AVX512F__)
+    return "avx-512";
+#elif defined(__AVX2__)
+    return "avx2";
+#else
+    return "sse2";
+#endif
+}
+
+enum class LineOrder {
+    RowSeqLineSeq,
+    RowSeqLineSkip,
+    RowSeqLineJump,
+    RowRevLineSeq,
+    RowRevLineJump,
+    LineSeqRowJump,
+};
+
+constexpr LineOrder kLineOrders[] = {
+    LineOrder::RowSeqLineSeq, LineOrder::RowSeqLineSkip, LineOrder::RowSeqLineJump,
+    LineOrder::RowRevLineSeq, LineOrder::RowRevLineJump, LineOrder::LineSeqRowJump,
+};
+
+inline const char* LineOrderName(LineOrder o) {
+    switch(o) {
+    case LineOrder::RowSeqLineSeq: return "row seq, cacheline seq";
+    case LineOrder::RowSeqLineSkip: return "row seq, cacheline skip";
+    case LineOrder::RowSeqLineJump: return "row seq, cacheline jump";
+    case LineOrder::RowRevLineSeq: return "row rev, cacheline seq";
+    case LineOrder::RowRevLineJump: return "row rev, cacheline jump";
+    case LineOrder::LineSeqRowJump: return "cacheline seq, row jump";
+    }
+    return "";
+}
+
+struct TraversalLevels {
+    int64_t stride[3];
+    int64_t count[3];
+};
+
+// address levels outer to inner: 0 row, 1 line, 2 chunk (traversal.h has the full matrix)
+namespace traversal_detail {
+
+template<int Level, bool Rev>
+struct Loop {
+    static constexpr int level = Level;
+    static constexpr bool reverse = Rev;
+};
+
+template<int Level, int64_t Line, int64_t Chunk>
+inline int64_t Stride(const TraversalLevels& lv) {
+    if constexpr (Level == 1 && Line != 0)
+        return Line;
+    else if constexpr (Level == 2 && Chunk != 0)
+        return Chunk;
+    else
+        return lv.stride[Level];
+}
+
+template<int Level, int64_t Line, int64_t Chunk>
+inline int64_t Count(const TraversalLevels& lv) {
+    if constexpr (Level == 2 && Line != 0 && Chunk != 0)
+        return Line / Chunk;
+    else
+        return lv.count[Level];
+}
+
+template<int64_t Line, int64_t Chunk, class Body, class L, class... Inner>
+inline void Nest(const TraversalLevels& lv, int64_t off, Body& body) {
+    const int64_t n = Count<L::level, Line, Chunk>(lv);
+    const int64_t s = Stride<L::level, Line, Chunk>(lv);
+    for(int64_t i = 0; i < n; ++i) {
+        int64_t o = off + (L::reverse ? n - 1 - i : i) * s;
+        if constexpr (sizeof...(Inner) == 0)
+            body(o);
+        else
+            Nest<Line, Chunk, Body, Inner...>(lv, o, body);
+    }
+}
+
+} // namespace traversal_detail
+
+// one pass over p[0 .. total), rows of `row` bytes: op.Line(q) for a whole line, op.Half(q) for 32 bytes.
+// each order is a loop nest over the row / line / chunk levels, row major or reversed
+template<class Op>
+inline void VisitLines(LineOrder o, Op& op, uint8_t* p, int64_t total, int64_t row) {
+    using namespace traversal_detail;
+    const TraversalLevels lv = { { row, 64, 32 }, { total / row, row / 64, 2 } };
+    auto line = [&](int64_t off) { op.Line(p + off); };
+    auto half = [&](int64_t off) { op.Half(p + off); };
+    using Row = Loop<0, false>;
+    using RowRev = Loop<0, true>;
+    using Line = Loop<1, false>;
+    using Chunk = Loop<2, false>;
+    switch(o) {
+    case LineOrder::RowSeqLineSeq: Nest<64, 32, decltype(line), Row, Line>(lv, 0, line); break;
+    case LineOrder::RowSeqLineSkip: Nest<64, 32, decltype(half), Row, Line>(lv, 0, half); break;
+    case LineOrder::RowSeqLineJump: Nest<64, 32, decltype(half), Row, Chunk, Line>(lv, 0, half); break;
+    case LineOrder::RowRevLineSeq: Nest<64, 32, decltype(line), RowRev, Line>(lv, 0, line); break;
+    case LineOrder::RowRevLineJump: Nest<64, 32, decltype(half), RowRev, Chunk, Line>(lv, 0, half); break;
+    case LineOrder::LineSeqRowJump: Nest<64, 32, decltype(half), Line, Chunk, Row>(lv, 0, half); break;
+    }
+}
+
+// a read pass, returns the folded data so it can't be dropped
+inline uint64_t ReadLines(LineOrder o, const uint8_t* p, int64_t total, int64_t row) {
+    LineAcc a;
+    VisitLines(o, a, const_cast<uint8_t*>(p), total, row); // LineAcc only loads
+    return a.Fold();
+}
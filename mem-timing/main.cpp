@@ -1,156 +1,162 @@
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 #include <iostream>
-#include <format>
-#include <ranges>
 #include <chrono>
 #include <random>
+#include <vector>
 
-class StopWatch {
-    using Clock = std::chrono::steady_clock;
-    Clock::time_point begin_;
-public:
-    StopWatch() {
-        begin_ = Clock::now();
-    }
-
-    size_t cost_ns() {
-        return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - begin_).count();
-    }
-};
+#include "bench_runner.h"
+#include "timing_common.h"
+#include "dram_geometry.h"
+#include "pointer_chase.h"
+#include "addr_map.h"
+#include "mlp.h"
+#include "tlb.h"
+#include "cache_probe.h"
+#include "latency_hist.h"
+#include "dram_model.h"
+#include "line_kernels.h"
+#include "traversal.h"
+#include "refresh.h"
+#include "write_patterns.h"
+#include "prefetch.h"
+#include "split_load.h"
+#include "monitor.h"
+#include "skew.h"
+#include "page_color.h"
+#include "core_map.h"
+#include "rw_mix.h"
 
-int main() {
-    constexpr int64_t retrycount = 5;
+// the six row / cacheline orders over a buffer much larger than the caches
+static int RunPatterns(bench::Runner& runner, const DramGeometry& geo) {
     constexpr int64_t totalsize = 1 * 1024 * 1024 * 1024;
 
-    constexpr int64_t freq = 2600; // 2600MHz = 5600MT/S
-    constexpr int64_t mem_chs = 4; // 2 channels per dimm, 2 dimm
-    constexpr int64_t mem_ch_size = 8; // channel width = 32bit
-    constexpr int64_t rowsize = (1 << 10) * 64; // 2^10, from HWiNFO -> memory -> row 0 -> column address bits. cacheline = 64
-    constexpr int64_t tCL = 42;
-    constexpr int64_t tRCD = 42;
-    constexpr int64_t tRP = 42;
-    constexpr int64_t tRAS = 82;
+    const int64_t rowsize = geo.rowsize;
 
-    auto ptr = (uint8_t*)_aligned_malloc(totalsize, rowsize);
+    auto ptr = (uint8_t*)AlignedAlloc(totalsize, std::max<int64_t>(rowsize, 4096));
+    if (!ptr) {
+        printf("%s", "out of memory.\n");
+        return 1;
+    }
 
     std::random_device rnd;
     for(int i = 0; i < totalsize; i += 4096)
         ptr[i] = rnd() % 256;
-    
-    int64_t fullseq;
-    int64_t cacheonly;
-    int64_t computecost;
-
-    {
-        StopWatch w1;
-        register int sum = 0;
-        for(int t = 0; t < retrycount; ++t) {
-            for(int row = 0; row < totalsize; row += rowsize) {
-                for(int rowoff = 0; rowoff < rowsize; rowoff += 64) { // change cacheline every iter
-                    for(int lineoff = 0; lineoff < 64; ++lineoff) {
-                        sum += ptr[row + rowoff + lineoff];
-                    }
-                }
-            }
-        }
-        auto cost_ns = w1.cost_ns() / retrycount;
-        fullseq = cost_ns;
-        std::clog
-            << sum
-            << "\rrow seq, cacheline seq: \t" << cost_ns << std::endl;
-    }
 
-    {
-        StopWatch w1;
-        register int sum = 0;
-        for(int t = 0; t < retrycount; ++t) {
-            for(int row = 0; row < totalsize; row += rowsize) {
-                for(int rowoff = 0; rowoff < rowsize; rowoff += 64) { // change cacheline every iter
-                    for(int lineoff = 0; lineoff < 1; ++lineoff) {
-                        sum += ptr[row + rowoff + lineoff];
-                    }
-                }
-            }
-        }
-        auto cost_ns = w1.cost_ns() / retrycount;
-        cacheonly = cost_ns;
-        computecost = (fullseq - cacheonly) * 64 / 63;
-        std::clog
-            << sum
-            << "\rrow seq, cacheline skip: \t" << cost_ns << std::endl;
-    }
-    
-    {
-        StopWatch w1;
-        register int sum = 0;
-        for(int t = 0; t < retrycount; ++t) {
-            for(int row = 0; row < totalsize; row += rowsize) {
-                for(int lineoff = 0; lineoff < 64; ++lineoff) {
-                    for(int rowoff = 0; rowoff < rowsize; rowoff += 64) { // change cacheline every iter
-                        sum += ptr[row + rowoff + lineoff];
-                    }
-                }
-            }
-        }
-        auto cost_ns = w1.cost_ns() / retrycount - computecost;
-        std::clog
-            << sum
-            << "\rrow seq, cacheline jump (no compute): \t" << cost_ns << std::endl;
+    // the same kernels over an L1 resident buffer: what a line costs without the memory system
+    constexpr int64_t l1size = 16 * 1024;
+    constexpr int64_t l1row = 4096;
+    auto l1buf = (uint8_t*)AlignedAlloc(l1size, 4096);
+    memset(l1buf, 1, l1size);
+
+    uint64_t sink = 0;
+    printf("kernels: %s full line loads\n", LineKernelIsa());
+    struct Row {
+        double dram_ns, l1_ns; // per line
+    };
+    std::vector<Row> rows;
+    for(auto order: kLineOrders) {
+        // one full pass per trial, ns per pass
+        auto samples = bench::Collect(runner.options(), [&]() {
+            StopWatch w1;
+            sink ^= ReadLines(order, ptr, totalsize, rowsize);
+            return (double)w1.cost_ns();
+        });
+        double pass_ns = runner.Add(LineOrderName(order), "ns", samples).stats.median;
+
+        const int64_t repeat = totalsize / l1size / 16;
+        auto l1samples = bench::Collect(runner.options(), [&]() {
+            StopWatch w1;
+            for(int64_t i = 0; i < repeat; ++i)
+                sink ^= ReadLines(order, l1buf, l1size, l1row);
+            return (double)w1.cost_ns() / repeat;
+        });
+        double l1_ns = runner.Add(std::string(LineOrderName(order)) + " (L1 resident)", "ns", l1samples, false).stats.median;
+        rows.push_back({ pass_ns / (totalsize / 64), l1_ns / (l1size / 64) });
     }
 
-    {
-        StopWatch w1;
-        register int sum = 0;
-        for(int t = 0; t < retrycount; ++t) {
-            for(int row = totalsize - rowsize; row >= 0; row -= rowsize) {
-                for(int rowoff = 0; rowoff < rowsize; rowoff += 64) {
-                    for(int lineoff = 0; lineoff < 64; ++lineoff) { // change cacheline every iter
-                        sum += ptr[row + rowoff + lineoff];
-                    }
-                }
-            }
-        }
-        auto cost_ns = w1.cost_ns() / retrycount - computecost;
-        std::clog
-            << sum
-            << "\rrow rev, cacheline seq (no compute): \t" << cost_ns << std::endl;
+    // a kernel whose L1 line cost is a real share of its memory line cost measures the core, not the memory
+    printf("%-26s | %12s | %12s | %8s\n", "pattern", "ns per line", "L1 ns/line", "compute");
+    for(size_t i = 0; i < rows.size(); ++i) {
+        double share = rows[i].l1_ns / rows[i].dram_ns;
+        printf("%-26s | %12.3f | %12.3f | %7.1f%%%s\n", LineOrderName(kLineOrders[i]), rows[i].dram_ns, rows[i].l1_ns, share * 100,
+            share > 0.25 ? "  compute bound" : "");
     }
 
-    {
-        StopWatch w1;
-        register int sum = 0;
-        for(int t = 0; t < retrycount; ++t) {
-            for(int row = totalsize - rowsize; row >= 0; row -= rowsize) {
-                for(int lineoff = 0; lineoff < 64; ++lineoff) {
-                    for(int rowoff = 0; rowoff < rowsize; rowoff += 64) { // change cacheline every iter
-                        sum += ptr[row + rowoff + lineoff];
-                    }
-                }
-            }
-        }
-        auto cost_ns = w1.cost_ns() / retrycount - computecost;
-        std::clog
-            << sum
-            << "\rrow rev, cacheline jump (no compute): \t" << cost_ns << std::endl;
+    std::clog << sink << "\r" << std::endl;
+    AlignedFree(l1buf);
+    AlignedFree(ptr);
+    return 0;
+}
+
+// mem-timing [patterns|geometry|chase|addrmap|mlp|tlb|cache|hist|model|matrix|refresh|write|prefetch|split|monitor|skew|color|coremap|rwmix] [--rowsize=bytes] [--no-detect] [runner options]
+int main(int argc, char** argv) {
+    bench::Options defaults;
+    defaults.min_trials = 5;
+    defaults.max_trials = 20;
+    defaults.max_seconds = 60;
+    bench::Runner runner("mem-timing", bench::Options::Parse(argc, argv, defaults));
+
+    std::string mode = argc > 1 && argv[1][0] != '-' ? argv[1] : "patterns";
+    int64_t rowsize = 0;
+    bool detect = true;
+    for(int i = 1; i < argc; ++i) {
+        if (strncmp(argv[i], "--rowsize=", 10) == 0)
+            rowsize = atoll(argv[i] + 10);
+        else if (strcmp(argv[i], "--no-detect") == 0)
+            detect = false;
     }
 
-    {
-        StopWatch w1;
-        register int sum = 0;
-        for(int t = 0; t < retrycount; ++t) {
-            for(int rowoff = 0; rowoff < rowsize; rowoff += 64) {
-                for(int lineoff = 0; lineoff < 64; ++lineoff) {
-                    for(int row = 0; row < totalsize; row += rowsize) { // change row every iter
-                        sum += ptr[row + rowoff + lineoff];
-                    }
-                }
-            }
-        }
-
-        auto cost_ns = w1.cost_ns() / retrycount - computecost;
-        std::clog
-            << sum
-            << "\rcacheline seq, row jump (no compute): \t" << cost_ns << std::endl;
+    // modes that don't depend on the geometry
+    if (mode == "addrmap")
+        return RunAddrMap(runner, argc, argv);
+    if (mode == "mlp")
+        return RunMlp(runner, argc, argv);
+    if (mode == "tlb")
+        return RunTlb(runner, argc, argv);
+    if (mode == "prefetch")
+        return RunPrefetch(runner, argc, argv);
+    if (mode == "split")
+        return RunSplitLoad(runner, argc, argv);
+    if (mode == "monitor")
+        return RunMonitor(argc, argv);
+    if (mode == "skew")
+        return RunSkew(runner, argc, argv);
+    if (mode == "color")
+        return RunPageColor(runner, argc, argv);
+    if (mode == "coremap")
+        return RunCoreMap(runner, argc, argv);
+    if (mode == "rwmix")
+        return RunRwMix(runner, argc, argv);
+
+    // the full channel sweep takes minutes, only on request
+    DramGeometry geo = detect ? DetectDramGeometry(runner, mode == "geometry") : DramGeometry();
+    if (rowsize > 0) {
+        geo.rowsize = rowsize;
+        geo.rowsize_from = "command line";
     }
-}
\ No newline at end of file
+    geo.Print();
+
+    if (mode == "geometry")
+        return 0;
+    if (mode == "patterns")
+        return RunPatterns(runner, geo);
+    if (mode == "chase")
+        return RunChase(runner, geo, argc, argv);
+    if (mode == "cache")
+        return RunCacheProbe(runner, geo, argc, argv);
+    if (mode == "hist")
+        return RunLatencyHist(runner, geo, argc, argv);
+    if (mode == "model")
+        return RunDramModel(runner, geo, argc, argv);
+    if (mode == "matrix")
+        return RunTraversalMatrix(runner, geo, argc, argv);
+    if (mode == "refresh")
+        return RunRefresh(runner, geo, argc, argv);
+    if (mode == "write")
+        return RunWritePatterns(runner, geo, argc, argv);
+
+    printf("unknown mode %s.\n", mode.c_str());
+    return 1;
+}
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstdio>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+
+#include "bench_runner.h"
+#include "timing_common.h"
+#include "pointer_chase.h"
+#include "topology.h"
+
+// memory level parallelism: k independent chains interleaved in one loop, so k misses can be in flight
+// the chains are k evenly spaced starting points on one random cycle and never meet
+
+// follows every chain `steps` times, the chains stay in registers up to ~12
+template<int K>
+inline void MlpChase(void** (&p)[32], int64_t steps) {
+    void** q[K];
+    for(int j = 0; j < K; ++j)
+        q[j] = p[j];
+    for(int64_t i = 0; i < steps; ++i) {
+        for(int j = 0; j < K; ++j)
+            q[j] = (void**)*q[j];
+    }
+    for(int j = 0; j < K; ++j)
+        p[j] = q[j];
+}
+
+inline const std::vector<int>& MlpChainCounts() {
+    static const std::vector<int> counts = { 1, 2, 3, 4, 5, 6, 8, 10, 12, 14, 16, 20, 24, 32 };
+    return counts;
+}
+
+inline void MlpRun(int k, void** (&p)[32], int64_t steps) {
+    switch(k) {
+    case 1: MlpChase<1>(p, steps); break;
+    case 2: MlpChase<2>(p, steps); break;
+    case 3: MlpChase<3>(p, steps); break;
+    case 4: MlpChase<4>(p, steps); break;
+    case 5: MlpChase<5>(p, steps); break;
+    case 6: MlpChase<6>(p, steps); break;
+    case 8: MlpChase<8>(p, steps); break;
+    case 10: MlpChase<10>(p, steps); break;
+    case 12: MlpChase<12>(p, steps); break;
+    case 14: MlpChase<14>(p, steps); break;
+    case 16: MlpChase<16>(p, steps); break;
+    case 20: MlpChase<20>(p, steps); break;
+    case 24: MlpChase<24>(p, steps); break;
+    case 32: MlpChase<32>(p, steps); break;
+    }
+}
+
+// k chain heads spread over the cycle starting at first
+inline void MlpHeads(void** first, int64_t nodes, int k, void** (&p)[32]) {
+    void** q = first;
+    for(int j = 0; j < k; ++j) {
+        p[j] = q;
+        q = Chase(q, nodes / k / 8 * 8);
+    }
+}
+
+struct MlpResult {
+    double latency_ns; // per load, per chain
+    double mbps;       // lines fetched per second x 64, all threads
+};
+
+// one random cycle per thread over its own slice of buf
+inline std::vector<void**> MlpCycles(uint8_t* buf, int64_t bufsize, int threads) {
+    std::vector<void**> first;
+    for(int i = 0; i < threads; ++i) {
+        ChaseConfig c;
+        c.working_set = bufsize / threads / 4096 * 4096;
+        first.push_back(BuildChase(buf + i * c.working_set, c));
+    }
+    return first;
+}
+
+// every thread chases k chains on its cycle, pinned to cpus[t]
+inline MlpResult MeasureMlp(bench::Runner& runner, const std::string& name, const std::vector<void**>& cycles,
+    int64_t nodes, const std::vector<int>& cpus, int k) {
+    const int threads = (int)cpus.size();
+    const int64_t steps = 100000;
+
+    struct Heads { void** p[32]; };
+    std::vector<Heads> heads(threads);
+    for(int i = 0; i < threads; ++i)
+        MlpHeads(cycles[i], nodes, k, heads[i].p);
+
+    std::vector<double> bw;
+    auto samples = bench::Collect(runner.options(), [&]() {
+        std::atomic<int> ready{0};
+        std::atomic<bool> go{false};
+        std::vector<double> ns(threads);
+        std::vector<std::thread> t;
+        for(int i = 0; i < threads; ++i) {
+            t.emplace_back([&, i]() {
+                PinThread(cpus[i]);
+                ++ready;
+                while(!go)
+                    ;
+                StopWatch w;
+                MlpRun(k, heads[i].p, steps);
+                ns[i] = (double)w.cost_ns();
+            });
+        }
+        while(ready < threads)
+            std::this_thread::yield();
+        go = true;
+        for(auto& th: t)
+            th.join();
+        double slowest = *std::max_element(ns.begin(), ns.end());
+        bw.push_back((double)threads * k * steps * 64 / 1048576.0 / (slowest / 1e9));
+        return slowest / steps;
+    });
+    volatile uintptr_t sink = (uintptr_t)heads[0].p[0];
+    (void)sink;
+    double lat = runner.Add(name + " latency", "ns", samples, false).stats.median;
+    double mbps = runner.Add(name + " bandwidth", "MB/S", bw, false).stats.median;
+    return MlpResult{ lat, mbps };
+}
+
+// mem-timing mlp [--ws=bytes] [--max-chains=n]
+inline int RunMlp(bench::Runner& runner, int argc, char** argv) {
+    const int64_t ws = ArgInt(argc, argv, "--ws=", 1024 * 1024 * 1024);
+    const int max_chains = (int)ArgInt(argc, argv, "--max-chains=", 32);
+
+    auto buf = (uint8_t*)AlignedAlloc(ws, 1 << 21);
+    if (!buf) {
+        printf("%s", "out of memory.\n");
+        return 1;
+    }
+    AdviseHugePages(buf, ws);
+    for(int64_t i = 0; i < ws; i += 4096)
+        buf[i] = 0;
+
+    // one core, then one thread on every physical core of package 0
+    auto topo = CpuTopology();
+    std::vector<int> socket;
+    std::vector<int> seen_cores;
+    for(auto& c: topo) {
+        if (c.package == 0 && std::find(seen_cores.begin(), seen_cores.end(), c.core) == seen_cores.end()) {
+            socket.push_back(c.cpu);
+            seen_cores.push_back(c.core);
+        }
+    }
+    struct Scope { std::string name; std::vector<int> cpus; };
+    std::vector<Scope> scopes = { { "1 core", { topo[0].cpu } } };
+    if (socket.size() > 1)
+        scopes.push_back({ "socket 0, " + std::to_string(socket.size()) + " cores", socket });
+
+    for(auto& scope: scopes) {
+        printf("%s:\n", scope.name.c_str());
+        printf("%s", "  chains | latency ns | MB/S       | x of 1 chain\n");
+        double base = 0;
+        auto cycles = MlpCycles(buf, ws, (int)scope.cpus.size());
+        int64_t nodes = ws / (int64_t)scope.cpus.size() / 4096 * 4096 / 64;
+        for(int k: MlpChainCounts()) {
+            if (k > max_chains)
+                break;
+            auto r = MeasureMlp(runner, "mlp " + scope.name + " " + std::to_string(k) + " chains", cycles, nodes, scope.cpus, k);
+            if (base == 0)
+                base = r.mbps;
+            printf("  %6d | %10.1f | %10.0f | %.2f\n", k, r.latency_ns, r.mbps, r.mbps / base);
+            fflush(stdout);
+        }
+    }
+
+    AlignedFree(buf);
+    return 0;
+}
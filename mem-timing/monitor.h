@@ -0,0 +1,173 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+
+#ifdef __linux__
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "timing_common.h"
+#include "pointer_chase.h"
+
+// long running health monitor: every interval a short random chase (latency) and a short copy
+// burst (bandwidth), one line per sample, to stdout, a file or a unix datagram socket
+//
+//   # time_ms latency_ns copy_gbs active_us duty_pct loads bytes
+//
+// the work per sample adapts so that the active time stays under --budget percent of the
+// interval: halved when over (down to 1K loads / 256 KB), doubled (up to 32K loads / 8 MB) when
+// under half of it. a minimum sample over the budget is flagged once with a # line; a sample that
+// overruns the interval starts the next interval from there, no catching up.
+// datagrams are sent with MSG_DONTWAIT, a slow or missing reader never stalls the monitor.
+
+namespace monitor_detail {
+
+class Sink {
+    FILE* file_ = stdout;
+    int sock_ = -1;
+#ifdef __linux__
+    sockaddr_un addr_ = {};
+#endif
+
+public:
+    bool Open(const char* path, const char* socket_path) {
+        if (socket_path) {
+#ifdef __linux__
+            sock_ = socket(AF_UNIX, SOCK_DGRAM, 0);
+            addr_.sun_family = AF_UNIX;
+            strncpy(addr_.sun_path, socket_path, sizeof(addr_.sun_path) - 1);
+            return sock_ >= 0;
+#else
+            printf("%s", "--socket needs Linux.\n");
+            return false;
+#endif
+        }
+        if (path)
+            file_ = fopen(path, "a");
+        return file_ != nullptr;
+    }
+
+    void Write(const std::string& line) {
+#ifdef __linux__
+        if (sock_ >= 0) {
+            sendto(sock_, line.data(), line.size(), MSG_DONTWAIT, (const sockaddr*)&addr_, sizeof(addr_));
+            return;
+        }
+#endif
+        fputs(line.c_str(), file_);
+        fflush(file_);
+    }
+
+    ~Sink() {
+#ifdef __linux__
+        if (sock_ >= 0)
+            close(sock_);
+#endif
+        if (file_ && file_ != stdout)
+            fclose(file_);
+    }
+};
+
+} // namespace monitor_detail
+
+// mem-timing monitor [--interval=ms] [--budget=percent] [--count=n] [--out=path] [--socket=path] [--ws=bytes]
+inline int RunMonitor(int argc, char** argv) {
+    using namespace monitor_detail;
+    const int64_t interval_ms = std::max<int64_t>(ArgInt(argc, argv, "--interval=", 1000), 1);
+    const double budget = atof(ArgValue(argc, argv, "--budget=") ? ArgValue(argc, argv, "--budget=") : "1");
+    const int64_t count = ArgInt(argc, argv, "--count=", 0);
+    const int64_t ws = ArgInt(argc, argv, "--ws=", 256 * 1024 * 1024);
+    const int64_t min_loads = 1024, max_loads = 1 << 15;
+    const int64_t min_bytes = 256 * 1024;
+    if (ws < 2 * min_bytes) {
+        printf("--ws must be at least %lld KB, half of it holds the %lld KB minimum copy.\n", (long long)(2 * min_bytes >> 10),
+            (long long)(min_bytes >> 10));
+        return 1;
+    }
+    const int64_t copy_region = std::min<int64_t>(ws / 2, 64 * 1024 * 1024);
+    const int64_t max_bytes = std::min<int64_t>(8 * 1024 * 1024, copy_region);
+
+    Sink out;
+    if (!out.Open(ArgValue(argc, argv, "--out="), ArgValue(argc, argv, "--socket="))) {
+        printf("%s", "can't open the output.\n");
+        return 1;
+    }
+
+    auto buf = (uint8_t*)AlignedAlloc(ws, 1 << 21);
+    auto src = (uint8_t*)AlignedAlloc(copy_region, 1 << 21);
+    auto dst = (uint8_t*)AlignedAlloc(copy_region, 1 << 21);
+    if (!buf || !src || !dst) {
+        printf("%s", "out of memory.\n");
+        return 1;
+    }
+    AdviseHugePages(buf, ws);
+    memset(src, 1, copy_region);
+    memset(dst, 0, copy_region);
+    ChaseConfig c;
+    c.working_set = ws;
+    void** p = BuildChase(buf, c);
+
+    // start small, the first samples mustn't blow the budget
+    int64_t loads = 4096, bytes = std::min<int64_t>(1024 * 1024, max_bytes), copy_off = 0;
+    bool warned = false;
+    const double budget_us = interval_ms * 1000.0 * budget / 100;
+    out.Write("# time_ms latency_ns copy_gbs active_us duty_pct loads bytes\n");
+
+    auto next = std::chrono::steady_clock::now();
+    for(int64_t n = 0; count == 0 || n < count; ++n) {
+        next += std::chrono::milliseconds(interval_ms);
+        StopWatch active;
+
+        StopWatch w;
+        p = Chase(p, loads);
+        double latency = (double)w.cost_ns() / loads;
+
+        // a different part of the region every time, so the copy misses the caches
+        if (copy_off + bytes > copy_region)
+            copy_off = 0;
+        StopWatch wc;
+        memcpy(dst + copy_off, src + copy_off, (size_t)bytes);
+        double gbs = (double)bytes / wc.cost_ns();
+        copy_off += bytes;
+
+        double active_us = active.cost_ns() / 1000.0;
+        auto now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        char line[256];
+        snprintf(line, sizeof(line), "%lld %.1f %.2f %.0f %.3f %lld %lld\n", (long long)now_ms, latency, gbs, active_us,
+            active_us / (interval_ms * 10.0), (long long)loads, (long long)bytes);
+        out.Write(line);
+
+        if (active_us > budget_us) {
+            if (loads == min_loads && bytes == min_bytes && !warned) {
+                snprintf(line, sizeof(line), "# the smallest sample (%lld loads, %lld KB) takes %.0f us, over the %.0f us budget\n",
+                    (long long)min_loads, (long long)(min_bytes >> 10), active_us, budget_us);
+                out.Write(line);
+                warned = true;
+            }
+            loads = std::max(loads / 2, min_loads);
+            bytes = std::max(bytes / 2, min_bytes);
+        } else if (active_us < budget_us / 2) {
+            loads = std::min(loads * 2, max_loads);
+            bytes = std::min(bytes * 2, max_bytes);
+        }
+        auto now = std::chrono::steady_clock::now();
+        if (now > next)
+            next = now; // overran the interval, the next one starts now
+        std::this_thread::sleep_until(next);
+    }
+
+    volatile uintptr_t sink = (uintptr_t)p;
+    (void)sink;
+    AlignedFree(dst);
+    AlignedFree(src);
+    AlignedFree(buf);
+    return 0;
+}
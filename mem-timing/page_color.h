@@ -0,0 +1,285 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <random>
+#include <algorithm>
+
+#include "bench_runner.h"
+#include "machine_profile.h"
+#include "timing_common.h"
+#include "pointer_chase.h"
+#include "topology.h"
+#include "addr_map.h"
+#include "row_locality.h"
+
+// software cache / bank partitioning: 4K pages of a hugetlb pool handed out by color
+//
+//   cache color  the llc set index bits above the page offset, (addr >> 12) & (colors - 1)
+//   bank color   the bank functions of `mem-timing addrmap` over the page number bits
+//
+// two workloads on disjoint colors can't evict each other's lines (cache) or close each
+// other's rows (bank). without root the physical address is only known inside one huge page,
+// the huge page offset bits (12..20 for 2M pages) are still enough for most llc colorings; bank
+// functions reaching above them are refused.
+
+struct PageColoring {
+    bool bank = false;
+    int colors = 1;
+    AddressMapping map;     // bank coloring, the functions over bits >= 12 only
+
+    int Color(uint64_t addr) const {
+        return bank ? map.Bank(addr) : (int)(addr >> 12 & (uint64_t)(colors - 1));
+    }
+};
+
+#ifdef __linux__
+
+class ColorAllocator {
+    addr_map_detail::Pool pool_;
+    std::vector<uint64_t> phys_;    // per pool page, empty: offsets only
+    PageColoring coloring_;
+    std::vector<std::vector<uint8_t*>> free_;
+
+public:
+    ColorAllocator(const addr_map_detail::Pool& pool, std::vector<uint64_t> phys, const PageColoring& c)
+        : pool_(pool), phys_(std::move(phys)), coloring_(c), free_((size_t)c.colors) {
+        for(size_t off = pool.size; off >= 4096; off -= 4096) // popped from the back, low addresses first
+            free_[(size_t)ColorOf(pool.base + off - 4096)].push_back(pool.base + off - 4096);
+    }
+
+    int ColorOf(const uint8_t* page) const {
+        size_t off = (size_t)(page - pool_.base);
+        return coloring_.Color(phys_.empty() ? off : phys_[off / pool_.page] + off % pool_.page);
+    }
+
+    size_t Free(int color) const { return free_[(size_t)color].size(); }
+
+    // n pages, round robin over the colors so that all their sets are used, empty if they run out
+    std::vector<uint8_t*> Alloc(size_t n, const std::vector<int>& colors) {
+        std::vector<uint8_t*> pages;
+        for(size_t i = 0; pages.size() < n; ++i) {
+            size_t tried = 0;
+            while(tried < colors.size() && free_[(size_t)colors[(i + tried) % colors.size()]].empty())
+                ++tried;
+            if (tried == colors.size()) {
+                Release(pages);
+                return {};
+            }
+            auto& list = free_[(size_t)colors[(i + tried) % colors.size()]];
+            pages.push_back(list.back());
+            list.pop_back();
+        }
+        return pages;
+    }
+
+    void Release(std::vector<uint8_t*>& pages) {
+        for(auto p: pages)
+            free_[(size_t)ColorOf(p)].push_back(p);
+        pages.clear();
+    }
+};
+
+namespace page_color_detail {
+
+// the lines of the pages in random order as one cycle
+inline void** LinkPages(const std::vector<uint8_t*>& pages) {
+    std::vector<uint8_t*> lines;
+    for(auto p: pages)
+        for(int l = 0; l < 4096; l += 64)
+            lines.push_back(p + l);
+    std::mt19937_64 mt(41);
+    std::shuffle(lines.begin(), lines.end(), mt);
+    for(size_t i = 0; i < lines.size(); ++i)
+        *(void**)lines[i] = lines[(i + 1) % lines.size()];
+    return (void**)lines[0];
+}
+
+struct Result {
+    double alone, loaded;   // victim ns per load
+    double aggressor_gbs;
+};
+
+// victim chase alone, then with the aggressor reading its pages on another cpu
+inline Result Interference(bench::Runner& runner, const std::string& name, const std::vector<uint8_t*>& victim,
+    const std::vector<uint8_t*>& aggressor, int victim_cpu, int aggressor_cpu) {
+    void** p = LinkPages(victim);
+    const int64_t steps = std::max<int64_t>((int64_t)victim.size() * 64, 1 << 20) / 8 * 8;
+    PinThread(victim_cpu);
+    p = Chase(p, steps);
+    auto measure = [&]() {
+        StopWatch w;
+        p = Chase(p, steps);
+        return (double)w.cost_ns() / steps;
+    };
+    Result r;
+    r.alone = runner.Add(name + " alone", "ns", bench::Collect(runner.options(), measure), false).stats.median;
+
+    std::atomic<bool> stop{false};
+    std::atomic<int64_t> bytes{0};
+    double aggressor_ns = 0;
+    std::thread t([&]() {
+        PinThread(aggressor_cpu);
+        uint64_t sink = 0;
+        StopWatch w;
+        while(!stop) {
+            for(auto page: aggressor)
+                for(int l = 0; l < 4096; l += 64)
+                    sink += *(volatile const uint64_t*)(page + l);
+            bytes += (int64_t)aggressor.size() * 4096;
+        }
+        aggressor_ns = (double)w.cost_ns();
+        volatile uint64_t keep = sink;
+        (void)keep;
+    });
+    r.loaded = runner.Add(name + " loaded", "ns", bench::Collect(runner.options(), measure), false).stats.median;
+    stop = true;
+    t.join();
+    r.aggressor_gbs = bytes / aggressor_ns;
+    volatile uintptr_t sink = (uintptr_t)p;
+    (void)sink;
+    return r;
+}
+
+} // namespace page_color_detail
+
+// mem-timing color [--pool=bytes] [--colors=n] [--banks=functions] [--victim=bytes] [--aggressor=bytes]
+inline int RunPageColor(bench::Runner& runner, int argc, char** argv) {
+    using namespace page_color_detail;
+    using addr_map_detail::Pool;
+    auto prof = MachineProfile::Load();
+    prof.Print();
+    const auto& llc = prof.LastLevel();
+
+    Pool pool = addr_map_detail::AllocPool((size_t)ArgInt(argc, argv, "--pool=", 1024 * 1024 * 1024));
+    if (!pool.base) {
+        printf("%s", "out of memory.\n");
+        return 1;
+    }
+    for(size_t i = 0; i < pool.size; i += 4096)
+        pool.base[i] = 1;
+    std::vector<uint64_t> phys = addr_map_detail::PhysicalPages(pool);
+    // bits below this are known: all of them, or the offset inside one huge page
+    const int known_bits = phys.empty() ? __builtin_ctzll(pool.page) : 64;
+
+    PageColoring coloring;
+    if (auto f = ArgValue(argc, argv, "--banks=")) {
+        coloring.bank = true;
+        auto functions = RowLocality::ParseBankFunctions(f);
+        if (functions.empty()) {
+            munmap(pool.map, pool.map_size);
+            return 1;
+        }
+        for(auto m: functions) {
+            // the bits above known_bits can't be seen: a function using them would color by a part
+            // of the bank, pages of one color would still share banks
+            if (known_bits < 64 && m >> known_bits) {
+                printf("bank function %s uses bits above %d, needs physical addresses (root, /proc/self/pagemap).\n",
+                    AddressMapping::Bits(m).c_str(), known_bits - 1);
+                munmap(pool.map, pool.map_size);
+                return 1;
+            }
+            // a function with a bit inside the page takes both values in every page, it can't
+            // split pages between banks: dropped whole, masking it would color by the other bits
+            if (m & 4095) {
+                printf("bank function %s uses bits below 12, not a per page color, dropped\n", AddressMapping::Bits(m).c_str());
+                continue;
+            }
+            if (m)
+                coloring.map.functions.push_back(m);
+        }
+        coloring.map.physical = known_bits == 64;
+        coloring.map.low_bit = 12;
+        coloring.map.high_bit = 12;
+        for(auto m: coloring.map.functions)
+            coloring.map.high_bit = std::max(coloring.map.high_bit, 64 - __builtin_clzll(m));
+        coloring.colors = 1 << coloring.map.functions.size();
+        coloring.map.Print();
+    } else {
+        // sets * 64 / 4096 pages fill the cache once, a power of two
+        int64_t colors = ArgInt(argc, argv, "--colors=", llc.size / std::max(llc.ways, 1) / 4096);
+        colors = std::min<int64_t>(colors, known_bits < 64 ? 1ll << (known_bits - 12) : colors);
+        coloring.colors = 1;
+        while(coloring.colors * 2 <= colors)
+            coloring.colors *= 2;
+    }
+    printf("pool: %zu MB of %s, %s addresses, %d %s colors\n", pool.size >> 20, pool.kind,
+        phys.empty() ? "huge page offset" : "physical", coloring.colors, coloring.bank ? "bank" : "cache");
+    if (coloring.colors < 2) {
+        printf("%s", "fewer than 2 colors, nothing to partition.\n");
+        munmap(pool.map, pool.map_size);
+        return 1;
+    }
+
+    // the victim fits in half of the llc (cache), or misses it (bank); the aggressor streams
+    const int64_t victim_bytes = ArgInt(argc, argv, "--victim=", coloring.bank ? llc.size * 2 : llc.size / 4);
+    const int64_t aggressor_bytes = ArgInt(argc, argv, "--aggressor=", llc.size * 2);
+
+    // two cores sharing the llc
+    auto topo = CpuTopology();
+    int victim_cpu = topo[0].cpu, aggressor_cpu = -1;
+    for(auto& c: topo) {
+        if (c.cpu != victim_cpu && c.cluster == topo[0].cluster && c.core != topo[0].core) {
+            aggressor_cpu = c.cpu;
+            break;
+        }
+    }
+    for(size_t i = 1; aggressor_cpu < 0 && i < topo.size(); ++i)
+        aggressor_cpu = topo[i].cpu;
+    if (aggressor_cpu < 0) {
+        printf("%s", "needs two cpus.\n");
+        munmap(pool.map, pool.map_size);
+        return 1;
+    }
+    printf("victim: cpu %d, %lld KB random chase; aggressor: cpu %d, %lld KB sequential reads\n", victim_cpu,
+        (long long)(victim_bytes >> 10), aggressor_cpu, (long long)(aggressor_bytes >> 10));
+
+    ColorAllocator alloc(pool, phys, coloring);
+    std::vector<int> all, low, high;
+    for(int c = 0; c < coloring.colors; ++c) {
+        all.push_back(c);
+        (c < coloring.colors / 2 ? low : high).push_back(c);
+    }
+    struct Case {
+        const char* name;
+        const std::vector<int>& victim;
+        const std::vector<int>& aggressor;
+    };
+    const Case cases[] = {
+        { "shared, all colors", all, all },
+        { "overlapping halves", low, low },
+        { "disjoint halves", low, high },
+    };
+    printf("%-20s | %9s | %9s | %8s | %13s\n", "case", "alone ns", "loaded ns", "slowdown", "aggressor GB/s");
+    for(auto& c: cases) {
+        auto v = alloc.Alloc((size_t)(victim_bytes / 4096), c.victim);
+        auto a = alloc.Alloc((size_t)(aggressor_bytes / 4096), c.aggressor);
+        if (v.empty() || a.empty()) {
+            printf("%-20s | pool too small, raise --pool or lower --victim / --aggressor\n", c.name);
+            alloc.Release(v);
+            alloc.Release(a);
+            continue;
+        }
+        auto r = Interference(runner, std::string("color ") + c.name, v, a, victim_cpu, aggressor_cpu);
+        printf("%-20s | %9.2f | %9.2f | %7.2fx | %13.2f\n", c.name, r.alone, r.loaded, r.loaded / r.alone, r.aggressor_gbs);
+        fflush(stdout);
+        alloc.Release(v);
+        alloc.Release(a);
+    }
+
+    munmap(pool.map, pool.map_size);
+    return 0;
+}
+
+#else
+
+inline int RunPageColor(bench::Runner&, int, char**) {
+    printf("%s", "color needs Linux (hugetlb, /proc/self/pagemap).\n");
+    return 1;
+}
+
+#endif
@@ -0,0 +1,207 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+#include "bench_runner.h"
+#include "timing_common.h"
+#include "dram_geometry.h"
+
+// dependent loads: every node holds the address of the next one, so only one miss is in flight
+//
+// the node order is the same loop nest as the patterns mode, with a node every `stride` bytes
+// instead of a byte: "cacheline seq" visits all nodes of a line before the next line,
+// "cacheline jump" visits node k of every line in the row, then node k + 1
+// random is a shuffle inside each `locality` region, regions in address order, one single cycle
+
+enum class ChaseOrder {
+    RowSeqLineSeq,
+    RowSeqLineJump,
+    RowRevLineSeq,
+    RowRevLineJump,
+    LineSeqRowJump,
+    Random,
+};
+
+inline const char* ChaseOrderName(ChaseOrder o) {
+    switch(o) {
+    case ChaseOrder::RowSeqLineSeq: return "row seq, cacheline seq";
+    case ChaseOrder::RowSeqLineJump: return "row seq, cacheline jump";
+    case ChaseOrder::RowRevLineSeq: return "row rev, cacheline seq";
+    case ChaseOrder::RowRevLineJump: return "row rev, cacheline jump";
+    case ChaseOrder::LineSeqRowJump: return "cacheline seq, row jump";
+    case ChaseOrder::Random: return "random";
+    }
+    return "";
+}
+
+struct ChaseConfig {
+    ChaseOrder order = ChaseOrder::Random;
+    int64_t working_set = 0;
+    int64_t stride = 64;    // bytes between nodes, >= 8
+    int64_t locality = 0;   // random order region, 0 = the whole working set
+    int64_t rowsize = 65536;
+};
+
+// links the nodes of buf[0 .. working_set) in the configured order, returns the first node
+inline void** BuildChase(uint8_t* buf, const ChaseConfig& c) {
+    void** first = nullptr;
+    void** prev = nullptr;
+    auto link = [&](int64_t off) {
+        auto node = (void**)(buf + off);
+        if (prev)
+            *prev = node;
+        else
+            first = node;
+        prev = node;
+    };
+
+    const int64_t ws = c.working_set;
+    const int64_t row = std::min(c.rowsize, ws);
+    const int64_t rows = ws / row;
+    const int64_t slots = std::max<int64_t>(64 / c.stride, 1); // nodes per line
+    const int64_t line = slots * c.stride;
+
+    auto row_lines = [&](int64_t r, bool jump) {
+        int64_t base = r * row;
+        if (jump) {
+            for(int64_t s = 0; s < slots; ++s)
+                for(int64_t l = 0; l < row; l += line)
+                    link(base + l + s * c.stride);
+        } else {
+            for(int64_t off = 0; off < row; off += c.stride)
+                link(base + off);
+        }
+    };
+
+    switch(c.order) {
+    case ChaseOrder::RowSeqLineSeq:
+    case ChaseOrder::RowSeqLineJump:
+        for(int64_t r = 0; r < rows; ++r)
+            row_lines(r, c.order == ChaseOrder::RowSeqLineJump);
+        break;
+    case ChaseOrder::RowRevLineSeq:
+    case ChaseOrder::RowRevLineJump:
+        for(int64_t r = rows - 1; r >= 0; --r)
+            row_lines(r, c.order == ChaseOrder::RowRevLineJump);
+        break;
+    case ChaseOrder::LineSeqRowJump:
+        for(int64_t off = 0; off < row; off += c.stride)
+            for(int64_t r = 0; r < rows; ++r)
+                link(r * row + off);
+        break;
+    case ChaseOrder::Random: {
+        std::mt19937_64 mt(12345);
+        const int64_t region = c.locality > 0 ? std::min(c.locality, ws) : ws;
+        std::vector<uint32_t> idx((size_t)(region / c.stride));
+        for(int64_t base = 0; base + region <= ws; base += region) {
+            for(size_t i = 0; i < idx.size(); ++i)
+                idx[i] = (uint32_t)i;
+            std::shuffle(idx.begin(), idx.end(), mt);
+            for(auto i: idx)
+                link(base + (int64_t)i * c.stride);
+        }
+        break;
+    }
+    }
+    if (prev)
+        *prev = first; // close the cycle
+    return first;
+}
+
+// follows `steps` links, returns where it ended so the loop can't be dropped
+inline void** Chase(void** p, int64_t steps) {
+    for(int64_t i = 0; i < steps; i += 8) {
+        p = (void**)*p;
+        p = (void**)*p;
+        p = (void**)*p;
+        p = (void**)*p;
+        p = (void**)*p;
+        p = (void**)*p;
+        p = (void**)*p;
+        p = (void**)*p;
+    }
+    return p;
+}
+
+// ns per dependent load, one trial walks the whole cycle at least once
+inline std::vector<double> MeasureChase(bench::Runner& runner, uint8_t* buf, const ChaseConfig& c) {
+    void** p = BuildChase(buf, c);
+    const int64_t nodes = c.working_set / c.stride;
+    const int64_t steps = std::max<int64_t>(nodes, 1 << 20) / 8 * 8;
+    p = Chase(p, nodes); // warm the caches / tlb the way the trials see them
+    auto samples = bench::Collect(runner.options(), [&]() {
+        StopWatch w;
+        p = Chase(p, steps);
+        return (double)w.cost_ns() / steps;
+    });
+    volatile uintptr_t sink = (uintptr_t)p;
+    (void)sink;
+    return samples;
+}
+
+// mem-timing chase [--order=name|all] [--stride=bytes] [--locality=bytes] [--min-ws=bytes] [--max-ws=bytes]
+inline int RunChase(bench::Runner& runner, const DramGeometry& geo, int argc, char** argv) {
+    std::vector<ChaseOrder> orders = {
+        ChaseOrder::Random, ChaseOrder::RowSeqLineSeq, ChaseOrder::RowSeqLineJump,
+        ChaseOrder::RowRevLineSeq, ChaseOrder::RowRevLineJump, ChaseOrder::LineSeqRowJump,
+    };
+    if (auto o = ArgValue(argc, argv, "--order=")) {
+        if (strcmp(o, "all") != 0) {
+            auto it = std::find_if(orders.begin(), orders.end(), [&](ChaseOrder c) { return ChaseOrderName(c) == std::string(o); });
+            if (it == orders.end()) {
+                printf("unknown order %s.\n", o);
+                return 1;
+            }
+            orders = { *it };
+        }
+    }
+    const int64_t stride = std::max<int64_t>(ArgInt(argc, argv, "--stride=", 64), 8) / 8 * 8;
+    const int64_t locality = ArgInt(argc, argv, "--locality=", 0);
+    const int64_t min_ws = ArgInt(argc, argv, "--min-ws=", 4 * 1024);
+    const int64_t max_ws = ArgInt(argc, argv, "--max-ws=", 1024 * 1024 * 1024);
+    if (min_ws < stride || min_ws > max_ws || (locality != 0 && locality < stride)) {
+        printf("%s", "need stride <= min-ws <= max-ws, and locality 0 or >= stride.\n");
+        return 1;
+    }
+
+    auto buf = (uint8_t*)AlignedAlloc(max_ws, 1 << 21);
+    if (!buf) {
+        printf("%s", "out of memory.\n");
+        return 1;
+    }
+    AdviseHugePages(buf, max_ws);
+    for(int64_t i = 0; i < max_ws; i += 4096)
+        buf[i] = 0;
+
+    double ghz = MeasureCoreGHz();
+    printf("core clock ~%.2f GHz (imul chain), stride %lld, locality %lld\n", ghz, (long long)stride, (long long)locality);
+
+    printf("%12s", "ws \\ ns, cy");
+    for(auto o: orders)
+        printf(" | %27s", ChaseOrderName(o));
+    printf("%s", "\n");
+    for(int64_t ws = min_ws; ws <= max_ws; ws *= 2) {
+        printf("%10lldKB", (long long)(ws / 1024));
+        for(auto o: orders) {
+            ChaseConfig c;
+            c.order = o;
+            c.working_set = ws;
+            c.stride = stride;
+            c.locality = locality;
+            c.rowsize = geo.rowsize;
+            auto& r = runner.Add(std::string("chase ") + ChaseOrderName(o) + " " + std::to_string(ws), "ns",
+                MeasureChase(runner, buf, c), false);
+            printf(" | %12.2f ns %8.1f cy", r.stats.median, r.stats.median * ghz);
+            fflush(stdout);
+        }
+        printf("%s", "\n");
+    }
+
+    AlignedFree(buf);
+    return 0;
+}
@@ -0,0 +1,259 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/mman.h>
+#endif
+
+#include "bench_runner.h"
+#include "timing_common.h"
+#include "topology.h"
+#include "tsc.h"
+
+// what the hardware prefetchers pick up, from dependent loads: a chain whose addresses follow a
+// pattern the prefetcher detects gets its misses turned into hits, the same nodes in random
+// order can't be prefetched. ratio = pattern / random, well below 1 means prefetched.
+//
+//   strides      one chain with a constant stride, forward and reverse
+//   streams      n sequential streams far apart, visited round robin
+//   4K boundary  tsc time of every load of a sequential chain, by line position in its page
+//
+// the chase has a single load instruction, ip based stride prefetchers see the real stride.
+// with --msr (intel, root, msr module) it all runs again with the four prefetchers off (msr 0x1a4).
+
+namespace prefetch_detail {
+
+// one load instruction in the loop, never unrolled
+inline void** ChaseOneIp(void** p, int64_t steps) {
+#if defined(__GNUC__)
+#pragma GCC unroll 1
+#endif
+    for(int64_t i = 0; i < steps; ++i)
+        p = (void**)*p;
+    return p;
+}
+
+inline void** Link(uint8_t* buf, const std::vector<int64_t>& offsets) {
+    for(size_t i = 0; i < offsets.size(); ++i)
+        *(void**)(buf + offsets[i]) = buf + offsets[(i + 1) % offsets.size()];
+    return (void**)(buf + offsets[0]);
+}
+
+inline double ChaseNs(bench::Runner& runner, const std::string& name, void** p, int64_t nodes) {
+    const int64_t steps = std::max<int64_t>(nodes, 1 << 20);
+    p = ChaseOneIp(p, nodes);
+    auto samples = bench::Collect(runner.options(), [&]() {
+        StopWatch w;
+        p = ChaseOneIp(p, steps);
+        return (double)w.cost_ns() / steps;
+    });
+    volatile uintptr_t sink = (uintptr_t)p;
+    (void)sink;
+    return runner.Add(name, "ns", samples, false).stats.median;
+}
+
+// the random baseline: the same nodes shuffled
+inline double RandomNs(bench::Runner& runner, const std::string& name, uint8_t* buf, std::vector<int64_t> offsets) {
+    std::mt19937_64 mt(17);
+    std::shuffle(offsets.begin(), offsets.end(), mt);
+    return ChaseNs(runner, name, Link(buf, offsets), (int64_t)offsets.size());
+}
+
+#ifdef __linux__
+// MISC_FEATURE_CONTROL: bit 0 L2 streamer, 1 L2 adjacent line, 2 L1 next line, 3 L1 ip stride
+// the saved value is written back by the destructor, and by SIGINT / SIGTERM so that ^C doesn't
+// leave the prefetchers off until reboot. other exits (SIGKILL, a crash) need the printed wrmsr
+struct PrefetchMsr {
+    static constexpr off_t kMsr = 0x1A4;
+    int fd = -1;
+    uint64_t saved = 0;
+
+    bool Open(int cpu) {
+        char vendor[13] = {};
+        unsigned r[4];
+        __cpuid(0, r[0], r[1], r[2], r[3]);
+        memcpy(vendor, &r[1], 4);
+        memcpy(vendor + 4, &r[3], 4);
+        memcpy(vendor + 8, &r[2], 4);
+        if (strcmp(vendor, "GenuineIntel") != 0)
+            return false;
+        fd = open(("/dev/cpu/" + std::to_string(cpu) + "/msr").c_str(), O_RDWR);
+        if (fd < 0)
+            return false;
+        if (pread(fd, &saved, 8, kMsr) != 8) {
+            close(fd);
+            fd = -1;
+            return false;
+        }
+        printf("msr 0x1a4 on cpu %d is 0x%llx, if the run dies: wrmsr -p %d 0x1a4 0x%llx\n", cpu, (unsigned long long)saved, cpu,
+            (unsigned long long)saved);
+        fflush(stdout);
+        signal_fd_ = fd;
+        signal_saved_ = saved;
+        struct sigaction sa = {};
+        sa.sa_handler = &Restore;
+        sigemptyset(&sa.sa_mask);
+        sigaction(SIGINT, &sa, &old_int_);
+        sigaction(SIGTERM, &sa, &old_term_);
+        return true;
+    }
+
+    bool Set(uint64_t v) {
+        return fd >= 0 && pwrite(fd, &v, 8, kMsr) == 8;
+    }
+
+    ~PrefetchMsr() {
+        if (fd >= 0) {
+            Set(saved);
+            sigaction(SIGINT, &old_int_, nullptr);
+            sigaction(SIGTERM, &old_term_, nullptr);
+            signal_fd_ = -1;
+            close(fd);
+        }
+    }
+
+private:
+    static inline volatile sig_atomic_t signal_fd_ = -1;
+    static inline uint64_t signal_saved_ = 0;
+    static inline struct sigaction old_int_, old_term_;
+
+    // async signal safe: pwrite, then die of the same signal with the default action
+    static void Restore(int sig) {
+        if (signal_fd_ >= 0) {
+            uint64_t v = signal_saved_;
+            (void)!pwrite(signal_fd_, &v, 8, kMsr);
+        }
+        signal(sig, SIG_DFL);
+        raise(sig);
+    }
+};
+#endif
+
+inline void RunSuite(bench::Runner& runner, const std::string& label, uint8_t* huge, uint8_t* small, int64_t ws) {
+    printf("-- prefetchers %s\n", label.c_str());
+
+    // strides
+    printf("%8s | %9s | %9s | %9s | %6s | %6s\n", "stride", "fwd ns", "rev ns", "random ns", "fwd", "rev");
+    for(int64_t s = 64; s <= 16384; s *= 2) {
+        const int64_t nodes = std::min<int64_t>(ws / s, 1 << 20);
+        std::vector<int64_t> fwd((size_t)nodes);
+        for(int64_t i = 0; i < nodes; ++i)
+            fwd[(size_t)i] = i * s;
+        std::vector<int64_t> rev(fwd.rbegin(), fwd.rend());
+        std::string n = "prefetch " + label + " stride " + std::to_string(s);
+        double f = ChaseNs(runner, n + " fwd", Link(huge, fwd), nodes);
+        double r = ChaseNs(runner, n + " rev", Link(huge, rev), nodes);
+        double x = RandomNs(runner, n + " random", huge, fwd);
+        printf("%8lld | %9.2f | %9.2f | %9.2f | %6.2f | %6.2f\n", (long long)s, f, r, x, f / x, r / x);
+    }
+
+    // streams: node i of every stream, then node i + 1. the starts are staggered inside the page,
+    // power of two apart they would all alias to the same cache sets
+    printf("%8s | %9s | %9s | %6s\n", "streams", "ns", "random ns", "ratio");
+    for(int64_t k: { 1, 2, 4, 8, 12, 16, 24, 32, 48, 64 }) {
+        const int64_t region = ws / k / 4096 * 4096;
+        const int64_t per = std::min<int64_t>(region / 64 - 64, (1 << 22) / k);
+        std::vector<int64_t> offs;
+        for(int64_t i = 0; i < per; ++i)
+            for(int64_t j = 0; j < k; ++j)
+                offs.push_back(j * region + (j * 13 % 64) * 64 + i * 64);
+        std::string n = "prefetch " + label + " streams " + std::to_string(k);
+        double t = ChaseNs(runner, n, Link(huge, offs), (int64_t)offs.size());
+        double x = RandomNs(runner, n + " random", huge, offs);
+        printf("%8lld | %9.2f | %9.2f | %6.2f\n", (long long)k, t, x, t / x);
+    }
+
+    // 4K boundary: a sequential chain timed load by load, split by position in the page
+    for(auto backing: { std::make_pair("2M pages", huge), std::make_pair("4K pages", small) }) {
+        if (!backing.second)
+            continue;
+        const int64_t nodes = std::min<int64_t>(ws / 64, 1 << 21);
+        std::vector<int64_t> offs((size_t)nodes);
+        for(int64_t i = 0; i < nodes; ++i)
+            offs[(size_t)i] = i * 64;
+        void** p = Link(backing.second, offs);
+        auto clock = TscClock::Calibrate();
+        std::vector<double> sum(64), cnt(64);
+        for(int64_t i = 0; i < nodes; ++i) {
+            size_t line = (size_t)((((uint8_t*)p - backing.second) & 4095) / 64);
+            uint64_t t0 = TscBegin();
+            p = (void**)*p;
+            uint64_t t1 = TscEnd();
+            sum[line] += clock.ns(t1 - t0);
+            cnt[line] += 1;
+        }
+        volatile uintptr_t sink = (uintptr_t)p;
+        (void)sink;
+        double rest = 0, rest_cnt = 0;
+        for(size_t l = 4; l < 64; ++l) {
+            rest += sum[l];
+            rest_cnt += cnt[l];
+        }
+        printf("4K boundary, %s, ns per load (tsc): line 0 %.1f, 1 %.1f, 2 %.1f, 3 %.1f, lines 4..63 %.1f\n", backing.first,
+            sum[0] / cnt[0], sum[1] / cnt[1], sum[2] / cnt[2], sum[3] / cnt[3], rest / rest_cnt);
+    }
+}
+
+} // namespace prefetch_detail
+
+// mem-timing prefetch [--ws=bytes] [--msr]
+inline int RunPrefetch(bench::Runner& runner, int argc, char** argv) {
+    using namespace prefetch_detail;
+    const int64_t ws = ArgInt(argc, argv, "--ws=", 256 * 1024 * 1024);
+    // 64 nodes at the largest stride, 64 streams of a few pages each
+    if (ws < 64 * 16384) {
+        printf("--ws must be at least %d KB.\n", 64 * 16);
+        return 1;
+    }
+    bool msr = false;
+    for(int i = 1; i < argc; ++i)
+        msr |= strcmp(argv[i], "--msr") == 0;
+
+    auto huge = (uint8_t*)AlignedAlloc(ws, 1 << 21);
+    if (!huge) {
+        printf("%s", "out of memory.\n");
+        return 1;
+    }
+    AdviseHugePages(huge, ws);
+    for(int64_t i = 0; i < ws; i += 4096)
+        huge[i] = 0;
+    uint8_t* small = nullptr;
+#ifdef MADV_NOHUGEPAGE
+    small = (uint8_t*)AlignedAlloc(ws, 1 << 21);
+    if (small) {
+        madvise(small, ws, MADV_NOHUGEPAGE);
+        for(int64_t i = 0; i < ws; i += 4096)
+            small[i] = 0;
+    }
+#endif
+
+    // the msr is per core, stay on the one it was written on
+    PinThread(0);
+    RunSuite(runner, "on", huge, small, ws);
+    if (msr) {
+#ifdef __linux__
+        PrefetchMsr m;
+        if (m.Open(0) && m.Set(m.saved | 0xF)) {
+            RunSuite(runner, "off", huge, small, ws);
+        } else {
+            printf("%s", "msr 0x1a4 not writable (needs intel, root and the msr module), timing only\n");
+        }
+#else
+        printf("%s", "--msr needs Linux /dev/cpu/*/msr\n");
+#endif
+    }
+
+    if (small)
+        AlignedFree(small);
+    AlignedFree(huge);
+    return 0;
+}
@@ -0,0 +1,200 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "bench_runner.h"
+#include "timing_common.h"
+#include "dram_geometry.h"
+#include "pointer_chase.h"
+#include "tsc.h"
+
+// refresh stalls from a long trace of single timed loads
+//
+// a random chase over a large buffer, every load timed with the tsc: each one is a row miss or
+// conflict, a load that lands on a bank being refreshed waits up to tRFC more. the trace goes to
+// a preallocated ring (nothing allocates while it runs). spikes above the threshold that are
+// close together are one event; the period is the peak of the autocorrelation of the event
+// train (histogram of the distances between events), the duration is the event length.
+//
+//   tREFI  ddr4 7.8 us, ddr5 3.9 us (1.95 us fine granularity), halved above 85 C
+//   tRFC   ~300 .. 400 ns for 16 Gb dies
+
+namespace refresh_detail {
+
+struct Sample {
+    uint64_t tsc;      // load start
+    uint32_t ticks;    // load duration, overhead included
+};
+
+struct Event {
+    double start_ns;
+    double length_ns;
+    double worst_ns;   // largest load latency inside
+};
+
+} // namespace refresh_detail
+
+// mem-timing refresh [--seconds=s] [--ring=samples] [--ws=bytes] [--threshold=x] [--max-lag=ns]
+inline int RunRefresh(bench::Runner& runner, const DramGeometry& geo, int argc, char** argv) {
+    using namespace refresh_detail;
+    const double seconds = atof(ArgValue(argc, argv, "--seconds=") ? ArgValue(argc, argv, "--seconds=") : "2");
+    const int64_t ring_size = ArgInt(argc, argv, "--ring=", 1 << 22);
+    const int64_t ws = ArgInt(argc, argv, "--ws=", 1024 * 1024 * 1024);
+    const double factor = atof(ArgValue(argc, argv, "--threshold=") ? ArgValue(argc, argv, "--threshold=") : "2");
+    const double max_lag = (double)ArgInt(argc, argv, "--max-lag=", 20000);
+    constexpr double lag_bin = 50; // ns
+    constexpr size_t skip = (size_t)(1000 / lag_bin); // lags under 1 us are the event merge window
+    if (ring_size < 1) {
+        printf("%s", "--ring must be at least 1 sample.\n");
+        return 1;
+    }
+    if (max_lag < 1000 + lag_bin) {
+        printf("--max-lag must be at least %.0f ns, lags under 1 us are merged into one event.\n", 1000 + lag_bin);
+        return 1;
+    }
+
+    auto buf = (uint8_t*)AlignedAlloc(ws, 1 << 21);
+    if (!buf) {
+        printf("%s", "out of memory.\n");
+        return 1;
+    }
+    AdviseHugePages(buf, ws);
+    for(int64_t i = 0; i < ws; i += 4096)
+        buf[i] = 0;
+    ChaseConfig c;
+    c.working_set = ws;
+    c.rowsize = geo.rowsize;
+    void** p = BuildChase(buf, c);
+    p = Chase(p, 1 << 20);
+
+    std::vector<Sample> ring((size_t)ring_size);
+    memset(ring.data(), 0, ring.size() * sizeof(Sample)); // fault the ring in before the trace
+
+    auto clock = TscClock::Calibrate();
+    printf("tsc %.3f GHz, %.1f s trace, ring of %lld samples\n", clock.ghz, seconds, (long long)ring_size);
+    const uint64_t end_tsc = __rdtsc() + (uint64_t)(seconds * 1e9 * clock.ghz);
+    int64_t n = 0;
+    for(;;) {
+        uint64_t t0 = TscBegin();
+        p = (void**)*p;
+        uint64_t t1 = TscEnd();
+        ring[(size_t)(n % ring_size)] = { t0, (uint32_t)std::min<uint64_t>(t1 - t0, UINT32_MAX) };
+        ++n;
+        if (t1 > end_tsc)
+            break;
+    }
+    volatile uintptr_t sink = (uintptr_t)p;
+    (void)sink;
+
+    // oldest first
+    const int64_t count = std::min(n, ring_size);
+    std::vector<Sample> trace((size_t)count);
+    for(int64_t i = 0; i < count; ++i)
+        trace[(size_t)i] = ring[(size_t)((n - count + i) % ring_size)];
+    const uint64_t base = trace.front().tsc;
+    const double span_ns = (trace.back().tsc - base) / clock.ghz;
+
+    std::vector<double> lat((size_t)count);
+    for(int64_t i = 0; i < count; ++i)
+        lat[(size_t)i] = clock.ns(trace[(size_t)i].ticks);
+    std::vector<double> sorted = lat;
+    std::sort(sorted.begin(), sorted.end());
+    auto& r = runner.Add("refresh load latency", "ns", sorted, false);
+    const double median = r.stats.median;
+    const double threshold = median * factor;
+    printf("%lld samples over %.1f ms (%.0f ns apart), load p50 %.1f, p99 %.1f, p99.9 %.1f ns, spike threshold %.1f ns\n",
+        (long long)count, span_ns / 1e6, span_ns / count, median, bench::Percentile(sorted, 0.99), bench::Percentile(sorted, 0.999), threshold);
+
+    // spikes within 1 us of each other are one stall
+    std::vector<Event> events;
+    int64_t spikes = 0;
+    for(int64_t i = 0; i < count; ++i) {
+        if (lat[(size_t)i] < threshold)
+            continue;
+        ++spikes;
+        double start = (trace[(size_t)i].tsc - base) / clock.ghz;
+        double stop = start + lat[(size_t)i];
+        if (!events.empty() && start - (events.back().start_ns + events.back().length_ns) < 1000) {
+            auto& e = events.back();
+            e.length_ns = std::max(e.length_ns, stop - e.start_ns);
+            e.worst_ns = std::max(e.worst_ns, lat[(size_t)i]);
+        } else {
+            events.push_back({ start, stop - start, lat[(size_t)i] });
+        }
+    }
+    if (events.size() < 3) {
+        printf("%zu spike events, nothing periodic to look for\n", events.size());
+        AlignedFree(buf);
+        return 0;
+    }
+
+    // autocorrelation of the event train: distances to the following events up to max_lag
+    std::vector<int64_t> lags((size_t)(max_lag / lag_bin) + 1);
+    for(size_t i = 0; i < events.size(); ++i) {
+        for(size_t j = i + 1; j < events.size(); ++j) {
+            double d = events[j].start_ns - events[i].start_ns;
+            if (d > max_lag)
+                break;
+            ++lags[(size_t)(d / lag_bin)];
+        }
+    }
+    // a random train gives a flat histogram: the median bin is the baseline
+    if (lags.size() <= skip) {
+        printf("%s", "no lag bins above the merge window.\n");
+        AlignedFree(buf);
+        return 1;
+    }
+    std::vector<int64_t> flat(lags.begin() + skip, lags.end());
+    std::nth_element(flat.begin(), flat.begin() + flat.size() / 2, flat.end());
+    const double expected = std::max<double>(1, (double)flat[flat.size() / 2]);
+    size_t peak = skip;
+    for(size_t b = skip; b < lags.size(); ++b) {
+        if (lags[b] > lags[peak])
+            peak = b;
+    }
+    // neighbours of the peak bin, the period is rarely an exact multiple of the bin
+    int64_t peak_count = lags[peak] + (peak + 1 < lags.size() ? lags[peak + 1] : 0) + lags[peak - 1];
+    double period = (peak + 0.5) * lag_bin;
+
+    std::vector<double> lengths, worst;
+    for(auto& e: events) {
+        lengths.push_back(e.length_ns);
+        worst.push_back(e.worst_ns);
+    }
+    std::sort(lengths.begin(), lengths.end());
+    std::sort(worst.begin(), worst.end());
+
+    // the tail without the spike samples
+    std::vector<double> quiet;
+    for(auto v: sorted) {
+        if (v < threshold)
+            quiet.push_back(v);
+    }
+
+    printf("%zu events (%lld spike loads, %.3f%% of loads), %.0f per ms\n", events.size(), (long long)spikes,
+        100.0 * spikes / count, events.size() / (span_ns / 1e6));
+    printf("event length p50 %.0f ns, worst load p50 %.0f ns, p90 %.0f ns\n", bench::Percentile(lengths, 0.5),
+        bench::Percentile(worst, 0.5), bench::Percentile(worst, 0.9));
+    printf("autocorrelation peak at %.2f us, %.1fx the baseline", period / 1000, peak_count / (3 * expected));
+    if (peak_count < 3 * expected * 2)
+        printf("%s", " (weak, may not be periodic)");
+    printf("%s", "\n");
+    // the strongest lags, harmonics of the period show up here too
+    std::vector<size_t> top;
+    for(size_t b = skip; b < lags.size(); ++b)
+        top.push_back(b);
+    std::sort(top.begin(), top.end(), [&](size_t a, size_t b) { return lags[a] > lags[b]; });
+    top.resize(std::min<size_t>(top.size(), 8));
+    std::sort(top.begin(), top.end());
+    for(auto b: top)
+        printf("  %6.2f us %8lld  %.1fx\n", (b + 0.5) * lag_bin / 1000, (long long)lags[b], lags[b] / expected);
+    printf("p99.9 %.1f ns with spikes, %.1f ns without\n", bench::Percentile(sorted, 0.999), bench::Percentile(quiet, 0.999));
+    printf("%s", "tREFI for reference: ddr4 7.8 us, ddr5 3.9 us, fine granularity 1.95 us\n");
+
+    AlignedFree(buf);
+    return 0;
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+
+#include "bench_runner.h"
+#include "timing_common.h"
+#include "line_kernels.h"
+#include "write_patterns.h"
+#include "topology.h"
+
+// bandwidth at a given read:write mix with every cpu busy, each thread sequential over its own slice
+//
+// the accesses are interleaved per line (3:1 = three lines read, one line written). read / write
+// GB/s are the bytes the program moved; a temporal store also reads the line for ownership, so the
+// bus column is read + 2 x write for temporal stores and read + write for non-temporal ones.
+
+namespace rw_mix_detail {
+
+struct Ratio {
+    const char* name;
+    int reads, writes;
+};
+
+constexpr Ratio kRatios[] = {
+    { "1:0", 1, 0 }, { "3:1", 3, 1 }, { "2:1", 2, 1 }, { "1:1", 1, 1 }, { "1:2", 1, 2 }, { "0:1", 0, 1 },
+};
+
+// one pass over [p, p + size)
+template<bool NonTemporal>
+inline uint64_t MixPass(const Ratio& r, uint8_t* p, int64_t size) {
+    if (r.writes == 0)
+        return ReadLines(LineOrder::RowSeqLineSeq, p, size, size);
+    write_patterns_detail::LineMix<NonTemporal> m(r.reads, r.writes);
+    VisitLines(LineOrder::RowSeqLineSeq, m, p, size, size);
+    m.w.Done();
+    return m.r.Fold();
+}
+
+// every slice is first touched by the thread that uses it, so its pages are on that thread's numa node
+inline void FirstTouch(const std::vector<int>& cpus, uint8_t* buf, int64_t slice) {
+    std::vector<std::thread> t;
+    for(size_t i = 0; i < cpus.size(); ++i) {
+        t.emplace_back([&, i]() {
+            PinThread(cpus[i]);
+            memset(buf + i * slice, 1, (size_t)slice);
+        });
+    }
+    for(auto& th: t)
+        th.join();
+}
+
+// ns of the slowest thread for one pass of every thread over its slice
+inline double MeasureMix(const Ratio& r, bool nt, const std::vector<int>& cpus, uint8_t* buf, int64_t slice) {
+    const int threads = (int)cpus.size();
+    std::atomic<int> ready{0};
+    std::atomic<bool> go{false};
+    std::vector<double> ns(threads);
+    std::vector<uint64_t> sink(threads);
+    std::vector<std::thread> t;
+    for(int i = 0; i < threads; ++i) {
+        t.emplace_back([&, i]() {
+            PinThread(cpus[i]);
+            ++ready;
+            while(!go)
+                ;
+            StopWatch w;
+            uint8_t* p = buf + i * slice;
+            sink[i] = nt ? MixPass<true>(r, p, slice) : MixPass<false>(r, p, slice);
+            ns[i] = (double)w.cost_ns();
+        });
+    }
+    while(ready < threads)
+        std::this_thread::yield();
+    go = true;
+    for(auto& th: t)
+        th.join();
+    volatile uint64_t keep = sink[0];
+    (void)keep;
+    return *std::max_element(ns.begin(), ns.end());
+}
+
+} // namespace rw_mix_detail
+
+// mem-timing rwmix [--ws=bytes] [--threads=n]
+inline int RunRwMix(bench::Runner& runner, int argc, char** argv) {
+    using namespace rw_mix_detail;
+    auto topo = CpuTopology();
+    const int threads = (int)std::clamp<int64_t>(ArgInt(argc, argv, "--threads=", (int64_t)topo.size()), 1, (int64_t)topo.size());
+    std::vector<int> cpus;
+    for(int i = 0; i < threads; ++i)
+        cpus.push_back(topo[i].cpu);
+    const int64_t slice = ArgInt(argc, argv, "--ws=", 1024 * 1024 * 1024) / threads / 4096 * 4096;
+    const int64_t ws = slice * threads;
+
+    auto buf = (uint8_t*)AlignedAlloc(ws, 1 << 21);
+    if (!buf) {
+        printf("%s", "out of memory.\n");
+        return 1;
+    }
+    AdviseHugePages(buf, ws);
+    FirstTouch(cpus, buf, slice);
+
+    printf("%d threads, %lld MB each, %s loads / stores\n", threads, (long long)(slice >> 20), LineKernelIsa());
+    printf("%-10s | %9s | %9s | %9s | %9s\n", "r:w", "total", "read", "write", "bus");
+    for(bool nt: { false, true }) {
+        for(auto& r: kRatios) {
+            if (nt && r.writes == 0)
+                continue; // same as the temporal one
+            std::string name = std::string("rwmix ") + r.name + (nt ? " nt" : "");
+            auto samples = bench::Collect(runner.options(), [&]() { return MeasureMix(r, nt, cpus, buf, ws / threads); });
+            double ns = runner.Add(name, "ns", samples, false).stats.median;
+            double total = ws / ns;
+            double read = total * r.reads / (r.reads + r.writes);
+            double write = total - read;
+            printf("%-10s | %9.2f | %9.2f | %9.2f | %9.2f\n", (std::string(r.name) + (nt ? " nt" : "")).c_str(), total, read, write,
+                read + write * (nt ? 1 : 2));
+            fflush(stdout);
+        }
+    }
+    printf("%s", "GB/s, bus: what the memory controller moved, temporal stores read the line first\n");
+
+    AlignedFree(buf);
+    return 0;
+}
@@ -0,0 +1,214 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstdio>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+#include "bench_runner.h"
+#include "machine_profile.h"
+#include "timing_common.h"
+
+// skewed access: zipf, hot / cold and gaussian locality streams over the lines of a buffer
+//
+// the line numbers are drawn up front into an index array, the timed loop only loads: each load
+// address depends on the previous load (its value is 0, added through a mask the compiler can't
+// see), so ns per access is the effective latency. items map to lines through a random
+// permutation, hot items are scattered the way hashed keys are.
+//
+// hit rates per level come from the lru stack distance of every access in the stream (fully
+// associative lru of the machine profile sizes), not from counters. the model column weights the
+// profile latencies with them, tlb misses and set conflicts aren't in it.
+
+namespace skew_detail {
+
+// rejection-inversion sampling (hormann, derflinger), ranks 1 .. n, no table
+class Zipf {
+    double n_, s_, h_x1_, h_n_, sc_;
+
+    static double Helper1(double x) { return std::abs(x) > 1e-8 ? std::log1p(x) / x : 1 - x * (0.5 - x * (1.0 / 3 - 0.25 * x)); }
+    static double Helper2(double x) { return std::abs(x) > 1e-8 ? std::expm1(x) / x : 1 + x * 0.5 * (1 + x / 3 * (1 + 0.25 * x)); }
+    double H(double x) const { return std::exp(-s_ * std::log(x)); }
+    double HIntegral(double x) const { double l = std::log(x); return Helper2((1 - s_) * l) * l; }
+    double HIntegralInverse(double x) const {
+        double t = std::max(x * (1 - s_), -1.0);
+        return std::exp(Helper1(t) * x);
+    }
+
+public:
+    Zipf(int64_t n, double s) : n_((double)n), s_(s) {
+        h_x1_ = HIntegral(1.5) - 1;
+        h_n_ = HIntegral(n_ + 0.5);
+        sc_ = 2 - HIntegralInverse(HIntegral(2.5) - H(2));
+    }
+
+    template<class Rng>
+    int64_t operator()(Rng& mt) const {
+        std::uniform_real_distribution<double> uni(0, 1);
+        for(;;) {
+            double u = h_n_ + uni(mt) * (h_x1_ - h_n_);
+            double x = HIntegralInverse(u);
+            double k = std::clamp(std::floor(x + 0.5), 1.0, n_);
+            if (k - x <= sc_ || u >= HIntegral(k + 0.5) - H(k))
+                return (int64_t)k;
+        }
+    }
+};
+
+// lru stack distance of every access of the stream run twice, counted on the second run
+// (distinct lines since the last access of the same line, fenwick tree over time)
+inline std::vector<int64_t> StackDistances(const std::vector<uint32_t>& idx, int64_t lines) {
+    const int64_t n = (int64_t)idx.size();
+    std::vector<int32_t> tree((size_t)(2 * n + 1));
+    auto add = [&](int64_t i, int32_t v) { for(++i; i <= 2 * n; i += i & -i) tree[(size_t)i] += v; };
+    auto sum = [&](int64_t i) { int64_t s = 0; for(++i; i > 0; i -= i & -i) s += tree[(size_t)i]; return s; };
+    std::vector<int64_t> last((size_t)lines, -1);
+    std::vector<int64_t> dist;
+    dist.reserve((size_t)n);
+    for(int64_t t = 0; t < 2 * n; ++t) {
+        uint32_t l = idx[(size_t)(t % n)];
+        int64_t prev = last[l];
+        if (t >= n)
+            dist.push_back(prev < 0 ? INT64_MAX : sum(t - 1) - sum(prev));
+        if (prev >= 0)
+            add(prev, -1);
+        add(t, 1);
+        last[l] = t;
+    }
+    return dist;
+}
+
+struct Distribution {
+    std::string name;
+    std::vector<uint32_t> idx;
+};
+
+} // namespace skew_detail
+
+// mem-timing skew [--ws=bytes] [--accesses=n] [--zipf=s] [--hot=fraction:share] [--sigma=fraction]
+inline int RunSkew(bench::Runner& runner, int argc, char** argv) {
+    using namespace skew_detail;
+    const int64_t ws = ArgInt(argc, argv, "--ws=", 1024 * 1024 * 1024);
+    const int64_t accesses = ArgInt(argc, argv, "--accesses=", 1 << 22);
+    const double zipf_s = atof(ArgValue(argc, argv, "--zipf=") ? ArgValue(argc, argv, "--zipf=") : "0.99");
+    double hot = 0.1, hot_share = 0.9;
+    if (auto v = ArgValue(argc, argv, "--hot="))
+        sscanf(v, "%lf:%lf", &hot, &hot_share);
+    const double sigma = atof(ArgValue(argc, argv, "--sigma=") ? ArgValue(argc, argv, "--sigma=") : "0.001");
+    const int64_t lines = ws / 64;
+
+    auto prof = MachineProfile::Load();
+    prof.Print();
+
+    auto buf = (uint8_t*)AlignedAlloc(ws, 1 << 21);
+    if (!buf) {
+        printf("%s", "out of memory.\n");
+        return 1;
+    }
+    AdviseHugePages(buf, ws);
+    memset(buf, 0, ws);
+
+    // item -> line
+    std::mt19937_64 mt(31);
+    std::vector<uint32_t> perm((size_t)lines);
+    for(int64_t i = 0; i < lines; ++i)
+        perm[(size_t)i] = (uint32_t)i;
+    std::shuffle(perm.begin(), perm.end(), mt);
+
+    std::vector<Distribution> dists;
+    auto draw = [&](const std::string& name, auto item) {
+        Distribution d{ name, std::vector<uint32_t>((size_t)accesses) };
+        for(auto& v: d.idx)
+            v = perm[(size_t)item()];
+        dists.push_back(std::move(d));
+    };
+    std::uniform_int_distribution<int64_t> any(0, lines - 1);
+    draw("uniform", [&]() { return any(mt); });
+    Zipf zipf(lines, zipf_s);
+    draw("zipf " + std::to_string(zipf_s).substr(0, 4), [&]() { return zipf(mt) - 1; });
+    const int64_t hot_lines = std::max<int64_t>(1, (int64_t)(lines * hot));
+    std::uniform_int_distribution<int64_t> in_hot(0, hot_lines - 1), in_cold(hot_lines, lines - 1);
+    std::bernoulli_distribution is_hot(hot_share);
+    draw("hot/cold " + std::to_string((int)(hot * 100)) + "%:" + std::to_string((int)(hot_share * 100)) + "%",
+        [&]() { return is_hot(mt) ? in_hot(mt) : in_cold(mt); });
+    // gaussian around a center that jumps every 64K accesses, in item space
+    std::normal_distribution<double> around(0, std::max(1.0, sigma * lines));
+    int64_t center = 0, phase = 0;
+    draw("gaussian " + std::to_string(sigma).substr(0, 6), [&]() {
+        if (phase++ % 65536 == 0)
+            center = any(mt);
+        return ((center + (int64_t)std::llround(around(mt))) % lines + lines) % lines;
+    });
+
+    struct Level {
+        const char* name;
+        int64_t lines;
+        double latency;
+    };
+    std::vector<Level> levels = { { "L1", prof.l1d.size / 64, prof.l1d.latency_ns }, { "L2", prof.l2.size / 64, prof.l2.latency_ns } };
+    if (prof.l3.size)
+        levels.push_back({ "L3", prof.l3.size / 64, prof.l3.latency_ns });
+    bool have_latency = std::all_of(levels.begin(), levels.end(), [](const Level& l) { return l.latency > 0; });
+
+    // memory latency for the model, from the uniform stream (mostly misses at the default sizes)
+    double memory_ns = 0;
+    printf("%-22s | %10s | %10s", "distribution", "ns/access", "distinct");
+    for(auto& l: levels)
+        printf(" | %6s", l.name);
+    printf(" | %6s | %10s\n", "memory", "model ns");
+    for(auto& d: dists) {
+        volatile uint64_t mask_src = 0;
+        const uint64_t mask = mask_src;
+        uint64_t v = 0;
+        auto pass = [&]() {
+            for(auto l: d.idx)
+                v = *(const uint64_t*)(buf + ((uint64_t)l << 6) + (v & mask));
+        };
+        pass(); // warm, the model counts the second run too
+        auto samples = bench::Collect(runner.options(), [&]() {
+            StopWatch w;
+            pass();
+            return (double)w.cost_ns() / accesses;
+        });
+        volatile uint64_t keep = v;
+        (void)keep;
+        double ns = runner.Add("skew " + d.name, "ns", samples, false).stats.median;
+
+        auto dist = StackDistances(d.idx, lines);
+        std::vector<uint32_t> distinct = d.idx;
+        std::sort(distinct.begin(), distinct.end());
+        int64_t distinct_lines = std::unique(distinct.begin(), distinct.end()) - distinct.begin();
+
+        std::vector<double> share;
+        double below = 0;
+        for(auto& l: levels) {
+            double hits = (double)std::count_if(dist.begin(), dist.end(), [&](int64_t x) { return x < l.lines; }) / dist.size();
+            share.push_back(hits - below);
+            below = hits;
+        }
+        double miss = 1 - below;
+        double cached = 0;
+        for(size_t i = 0; i < levels.size(); ++i)
+            cached += share[i] * levels[i].latency;
+        if (d.name == "uniform" && miss > 0.5)
+            memory_ns = (ns - cached) / miss; // the rest of the uniform time is memory
+        printf("%-22s | %10.2f | %8lld K", d.name.c_str(), ns, (long long)(distinct_lines / 1000));
+        for(auto s: share)
+            printf(" | %5.1f%%", s * 100);
+        printf(" | %5.1f%%", miss * 100);
+        if (have_latency && memory_ns > 0) {
+            printf(" | %10.2f\n", cached + miss * memory_ns);
+        } else {
+            printf(" | %10s\n", "-");
+        }
+        fflush(stdout);
+    }
+    if (!have_latency)
+        printf("%s", "no cache latencies in the machine profile, run `mem-timing cache` for the model column\n");
+
+    AlignedFree(buf);
+    return 0;
+}
@@ -0,0 +1,186 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+#include "bench_runner.h"
+#include "machine_profile.h"
+#include "timing_common.h"
+
+// unaligned load penalties: 8 / 16 / 32 / 64 byte loads that are aligned, cross a cache line, or
+// cross a 4K page, from L1, L2 and memory resident buffers
+//
+//   slot stride 128    aligned: offset 0, line split: offset 64 - width / 2 (64 - 16 for 64 bytes)
+//   slot stride 4096   aligned: offset 0, page split: offset 4096 - width / 2 (4096 - 16)
+//
+// throughput: independent loads over the slots in order, ns per load.
+// latency: the slots in random order as a chain, the next address is in the low 8 bytes of the load.
+// without avx-512 a 64 byte load is two 32 byte loads, one of them splits.
+
+namespace split_load_detail {
+
+template<int W>
+struct Loader {
+#if defined(__AVX512F__)
+    __m512i acc = _mm512_setzero_si512();
+#endif
+    __m256i acc256 = _mm256_setzero_si256();
+
+    // the low 8 bytes of the load
+    uint64_t Load(const uint8_t* p) {
+        if constexpr (W == 8) {
+            __m128i v = _mm_loadl_epi64((const __m128i*)p);
+            acc256 = _mm256_xor_si256(acc256, _mm256_castsi128_si256(v));
+            return (uint64_t)_mm_cvtsi128_si64(v);
+        } else if constexpr (W == 16) {
+            __m128i v = _mm_loadu_si128((const __m128i*)p);
+            acc256 = _mm256_xor_si256(acc256, _mm256_castsi128_si256(v));
+            return (uint64_t)_mm_cvtsi128_si64(v);
+        } else if constexpr (W == 32) {
+            __m256i v = _mm256_loadu_si256((const __m256i*)p);
+            acc256 = _mm256_xor_si256(acc256, v);
+            return (uint64_t)_mm_cvtsi128_si64(_mm256_castsi256_si128(v));
+        } else {
+#if defined(__AVX512F__)
+            __m512i v = _mm512_loadu_si512(p);
+            acc = _mm512_xor_si512(acc, v);
+            return (uint64_t)_mm_cvtsi128_si64(_mm512_castsi512_si128(v));
+#else
+            __m256i v = _mm256_loadu_si256((const __m256i*)p);
+            acc256 = _mm256_xor_si256(acc256, _mm256_xor_si256(v, _mm256_loadu_si256((const __m256i*)(p + 32))));
+            return (uint64_t)_mm_cvtsi128_si64(_mm256_castsi256_si128(v));
+#endif
+        }
+    }
+
+    uint64_t Fold() const {
+        __m256i x = acc256;
+#if defined(__AVX512F__)
+        x = _mm256_xor_si256(x, _mm256_xor_si256(_mm512_castsi512_si256(acc), _mm512_extracti64x4_epi64(acc, 1)));
+#endif
+        return (uint64_t)(_mm256_extract_epi64(x, 0) ^ _mm256_extract_epi64(x, 1) ^ _mm256_extract_epi64(x, 2) ^ _mm256_extract_epi64(x, 3));
+    }
+};
+
+struct Case {
+    int64_t stride;
+    int64_t offset;    // from the slot start
+};
+
+// ns per load, independent loads
+template<int W>
+inline double Throughput(bench::Runner& runner, const std::string& name, uint8_t* buf, int64_t size, Case c) {
+    const int64_t slots = size / c.stride;
+    const int64_t passes = std::max<int64_t>(1, (1 << 22) / slots);
+    uint64_t sink = 0;
+    auto samples = bench::Collect(runner.options(), [&]() {
+        Loader<W> l;
+        StopWatch w;
+        for(int64_t k = 0; k < passes; ++k) {
+            const uint8_t* p = buf + c.offset;
+            for(int64_t i = 0; i < slots; ++i, p += c.stride)
+                l.Load(p);
+        }
+        double ns = (double)w.cost_ns() / (passes * slots);
+        sink ^= l.Fold();
+        return ns;
+    });
+    volatile uint64_t keep = sink;
+    (void)keep;
+    return runner.Add(name, "ns", samples, false).stats.median;
+}
+
+// ns per load, every load waits for the previous one
+template<int W>
+inline double Latency(bench::Runner& runner, const std::string& name, uint8_t* buf, int64_t size, Case c) {
+    const int64_t slots = size / c.stride;
+    std::vector<int64_t> order((size_t)slots);
+    for(int64_t i = 0; i < slots; ++i)
+        order[(size_t)i] = i * c.stride + c.offset;
+    std::mt19937_64 mt(23);
+    std::shuffle(order.begin(), order.end(), mt);
+    for(int64_t i = 0; i < slots; ++i) {
+        uint64_t next = (uint64_t)(buf + order[(size_t)((i + 1) % slots)]);
+        memcpy(buf + order[(size_t)i], &next, 8); // may straddle the line / page itself
+    }
+    const int64_t steps = std::max<int64_t>(slots, 1 << 20);
+    const uint8_t* p = buf + order[0];
+    Loader<W> l;
+    auto samples = bench::Collect(runner.options(), [&]() {
+        StopWatch w;
+        for(int64_t i = 0; i < steps; ++i)
+            p = (const uint8_t*)l.Load(p);
+        return (double)w.cost_ns() / steps;
+    });
+    volatile uint64_t keep = l.Fold() ^ (uintptr_t)p;
+    (void)keep;
+    return runner.Add(name, "ns", samples, false).stats.median;
+}
+
+template<int W>
+inline void RunWidth(bench::Runner& runner, const char* level, uint8_t* buf, int64_t size) {
+    // bytes before the boundary: half the load, 16 for 64 so that one of two 32 byte halves splits
+    constexpr int64_t before = W == 64 ? 16 : W / 2;
+    const Case aligned{ 128, 0 }, line{ 128, 64 - before }, aligned_page{ 4096, 0 }, page{ 4096, 4096 - before };
+    std::string n = std::string("split ") + level + " " + std::to_string(W) + " ";
+    double t[4] = {
+        Throughput<W>(runner, n + "aligned tput", buf, size, aligned),
+        Throughput<W>(runner, n + "line split tput", buf, size, line),
+        Throughput<W>(runner, n + "aligned 4K stride tput", buf, size, aligned_page),
+        Throughput<W>(runner, n + "page split tput", buf, size, page),
+    };
+    double l[4] = {
+        Latency<W>(runner, n + "aligned latency", buf, size, aligned),
+        Latency<W>(runner, n + "line split latency", buf, size, line),
+        Latency<W>(runner, n + "aligned 4K stride latency", buf, size, aligned_page),
+        Latency<W>(runner, n + "page split latency", buf, size, page),
+    };
+    printf("%-6s %3d | %6.2f %6.2f %5.2fx %6.2f %6.2f %5.2fx | %6.2f %6.2f %5.2fx %6.2f %6.2f %5.2fx\n", level, W,
+        t[0], t[1], t[1] / t[0], t[2], t[3], t[3] / t[2], l[0], l[1], l[1] / l[0], l[2], l[3], l[3] / l[2]);
+    fflush(stdout);
+}
+
+} // namespace split_load_detail
+
+// mem-timing split [--ws=bytes]
+inline int RunSplitLoad(bench::Runner& runner, int argc, char** argv) {
+    using namespace split_load_detail;
+    auto prof = MachineProfile::Load();
+    const int64_t ws = ArgInt(argc, argv, "--ws=", 256 * 1024 * 1024);
+    struct Level {
+        const char* name;
+        int64_t size;
+    };
+    // half of each cache, the page split slots need 4 pages at least
+    const Level levels[] = {
+        { "L1", std::max<int64_t>(prof.l1d.size / 2, 16 * 1024) },
+        { "L2", std::max<int64_t>(prof.l2.size / 2, 128 * 1024) },
+        { "memory", ws },
+    };
+    prof.Print();
+
+    auto buf = (uint8_t*)AlignedAlloc(ws + 4096, 1 << 21);
+    if (!buf) {
+        printf("%s", "out of memory.\n");
+        return 1;
+    }
+    AdviseHugePages(buf, ws + 4096);
+    memset(buf, 0, ws + 4096);
+
+    printf("%-10s | %-45s | %-45s\n", "", "throughput, ns per load", "latency, ns per load");
+    printf("%-10s | %6s %6s %6s %6s %6s %6s | %6s %6s %6s %6s %6s %6s\n", "level  W", "align", "line", "", "al 4K", "page", "",
+        "align", "line", "", "al 4K", "page", "");
+    for(auto& lv: levels) {
+        RunWidth<8>(runner, lv.name, buf, lv.size);
+        RunWidth<16>(runner, lv.name, buf, lv.size);
+        RunWidth<32>(runner, lv.name, buf, lv.size);
+        RunWidth<64>(runner, lv.name, buf, lv.size);
+    }
+
+    AlignedFree(buf);
+    return 0;
+}
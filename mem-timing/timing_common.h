@@ -0,0 +1,150 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <chrono>
+#include <algorithm>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+
+#ifdef __linux__
+#include <sys/mman.h>
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB (30 << 26) // linux/mman.h, older glibc doesn't forward it
+#endif
+#endif
+
+class StopWatch {
+    using Clock = std::chrono::steady_clock;
+    Clock::time_point begin_;
+public:
+    StopWatch() {
+        begin_ = Clock::now();
+    }
+
+    size_t cost_ns() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - begin_).count();
+    }
+};
+
+inline void* AlignedAlloc(size_t size, size_t align) {
+#ifdef _WIN32
+    return _aligned_malloc(size, align);
+#else
+    void* p = nullptr;
+    return posix_memalign(&p, align, size) == 0 ? p : nullptr;
+#endif
+}
+
+inline void AlignedFree(void* p) {
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    free(p);
+#endif
+}
+
+// evict one line from every cache level
+inline void FlushLine(const void* p) {
+    _mm_clflush(p);
+}
+
+inline void FullFence() {
+    _mm_mfence();
+}
+
+// fewer tlb misses in the latency numbers, transparent huge pages where the kernel allows
+inline void AdviseHugePages(void* p, size_t size) {
+#ifdef MADV_HUGEPAGE
+    madvise(p, size, MADV_HUGEPAGE);
+#else
+    (void)p;
+    (void)size;
+#endif
+}
+
+// bytes of [p, p + size) on huge pages: hugetlb mappings, and AnonHugePages of the others in
+// /proc/self/smaps. 0 where smaps isn't there, callers treat that as 4K pages
+inline size_t HugePageBytes(const void* p, size_t size) {
+    size_t huge = 0;
+#ifdef __linux__
+    FILE* f = fopen("/proc/self/smaps", "r");
+    if (!f)
+        return 0;
+    const uintptr_t lo = (uintptr_t)p, hi = lo + size;
+    size_t overlap = 0, kernel_kb = 4;
+    char line[256];
+    auto flush = [&](size_t anon_kb) {
+        huge += kernel_kb >= 2048 ? overlap : std::min(overlap, anon_kb * 1024);
+    };
+    while(fgets(line, sizeof(line), f)) {
+        unsigned long long start, end;
+        size_t kb;
+        if (sscanf(line, "%llx-%llx ", &start, &end) == 2) { // a mapping header
+            overlap = (size_t)std::max<long long>(0, (long long)std::min<uintptr_t>(hi, (uintptr_t)end) - (long long)std::max<uintptr_t>(lo, (uintptr_t)start));
+            kernel_kb = 4;
+        } else if (overlap && sscanf(line, "KernelPageSize: %zu kB", &kb) == 1) {
+            kernel_kb = kb;
+        } else if (overlap && sscanf(line, "AnonHugePages: %zu kB", &kb) == 1) {
+            flush(kb);
+        }
+    }
+    fclose(f);
+#else
+    (void)p;
+    (void)size;
+#endif
+    return huge;
+}
+
+// core clock from a dependent imul + xor chain, 4 cycles per step on every x86 since Sandy Bridge / Zen
+inline double MeasureCoreGHz() {
+    volatile uint64_t seed = 3;
+    std::vector<double> ghz;
+    for(int t = 0; t < 7; ++t) {
+        uint64_t x = seed, y = seed + 1, k = seed | 1;
+        const int64_t steps = 8 * 1000 * 1000;
+        StopWatch w;
+        for(int64_t i = 0; i < steps; i += 4) {
+            x = (x * k) ^ y;
+            x = (x * k) ^ k;
+            x = (x * k) ^ y;
+            x = (x * k) ^ k;
+        }
+        double ns = (double)w.cost_ns();
+        seed = x;
+        ghz.push_back(steps * 4 / ns);
+    }
+    std::sort(ghz.begin(), ghz.end());
+    return ghz[ghz.size() / 2];
+}
+
+inline int Parity64(uint64_t x) {
+#ifdef _MSC_VER
+    return (int)(__popcnt64(x) & 1);
+#else
+    return __builtin_parityll(x);
+#endif
+}
+
+// value of --key=value in argv, or nullptr
+inline const char* ArgValue(int argc, char** argv, const char* key) {
+    size_t n = strlen(key);
+    for(int i = 1; i < argc; ++i) {
+        if (strncmp(argv[i], key, n) == 0)
+            return argv[i] + n;
+    }
+    return nullptr;
+}
+
+inline int64_t ArgInt(int argc, char** argv, const char* key, int64_t def) {
+    auto v = ArgValue(argc, argv, key);
+    return v ? atoll(v) : def;
+}
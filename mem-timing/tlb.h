@@ -0,0 +1,179 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+#include "bench_runner.h"
+#include "timing_common.h"
+#include "pointer_chase.h"
+
+// tlb reach and page walk cost
+//
+// one line per 4K page, pages in random order, the line inside each page is random too so the
+// lines spread over all cache sets. the same chase runs over 4K, 2M and 1G backed memory:
+// the cache footprint is identical, only the number of translations differs.
+
+#ifdef __linux__
+
+namespace tlb_detail {
+
+struct Backing {
+    const char* name;
+    size_t pagesize;
+    int flags;     // extra mmap flags
+    int advice;    // madvise, 0 = none
+};
+
+// map `span` bytes aligned to the page size, nullptr if the backing isn't available
+inline uint8_t* MapBacking(const Backing& b, size_t span, void*& map, size_t& map_size) {
+    map_size = span + (b.flags ? 0 : b.pagesize);
+    map = mmap(nullptr, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | b.flags, -1, 0);
+    if (map == MAP_FAILED)
+        return nullptr;
+    auto p = (uint8_t*)(((uintptr_t)map + b.pagesize - 1) & ~(uintptr_t)(b.pagesize - 1));
+    if (b.advice)
+        madvise(p, span, b.advice);
+    for(size_t i = 0; i < span; i += 4096)
+        p[i] = 0;
+    return p;
+}
+
+// cycle through one random line of each of the first `pages` 4K pages
+inline void** BuildPageChase(uint8_t* p, int64_t pages, std::mt19937_64& mt) {
+    std::vector<uint32_t> order((size_t)pages);
+    for(int64_t i = 0; i < pages; ++i)
+        order[i] = (uint32_t)i;
+    std::shuffle(order.begin(), order.end(), mt);
+    void** first = nullptr;
+    void** prev = nullptr;
+    for(auto page: order) {
+        auto node = (void**)(p + (int64_t)page * 4096 + (mt() % 64) * 64);
+        if (prev)
+            *prev = node;
+        else
+            first = node;
+        prev = node;
+    }
+    *prev = first;
+    return first;
+}
+
+} // namespace tlb_detail
+
+// mem-timing tlb [--max-span=bytes]
+inline int RunTlb(bench::Runner& runner, int argc, char** argv) {
+    using namespace tlb_detail;
+    const int64_t max_span = ArgInt(argc, argv, "--max-span=", 1024 * 1024 * 1024);
+    const int64_t max_pages = max_span / 4096;
+
+    std::vector<Backing> backings = {
+        { "4K", 4096, 0, MADV_NOHUGEPAGE },
+        { "2M THP", 2u << 20, 0, MADV_HUGEPAGE },
+#ifdef MAP_HUGE_1GB
+        { "1G hugetlb", 1u << 30, MAP_HUGETLB | MAP_HUGE_1GB, 0 },
+#endif
+    };
+
+    std::vector<int64_t> counts;
+    for(int64_t n = 8; n <= max_pages; n *= 2)
+        counts.push_back(n);
+
+    // ns per load: [backing][count], < 0 if the backing is missing
+    std::vector<std::vector<double>> lat(backings.size(), std::vector<double>(counts.size(), -1));
+    for(size_t b = 0; b < backings.size(); ++b) {
+        auto& back = backings[b];
+        size_t span = (size_t)std::max<int64_t>(max_span, (int64_t)back.pagesize);
+        void* map;
+        size_t map_size;
+        uint8_t* p = MapBacking(back, span, map, map_size);
+        if (!p) {
+            printf("%s: not available\n", back.name);
+            continue;
+        }
+        // THP is a hint: a partly 4K backed span would be timed as huge pages
+        if (back.pagesize > 4096) {
+            size_t huge = HugePageBytes(p, span);
+            if (huge < span) {
+                printf("%s: only %zu of %zu MB in huge pages, not available\n", back.name, huge >> 20, span >> 20);
+                munmap(map, map_size);
+                continue;
+            }
+        }
+
+        std::mt19937_64 mt(99);
+        for(size_t c = 0; c < counts.size(); ++c) {
+            void** q = BuildPageChase(p, counts[c], mt);
+            const int64_t steps = std::max<int64_t>(counts[c] * 4, 1 << 20) / 8 * 8;
+            q = Chase(q, counts[c]);
+            auto samples = bench::Collect(runner.options(), [&]() {
+                StopWatch w;
+                q = Chase(q, steps);
+                return (double)w.cost_ns() / steps;
+            });
+            volatile uintptr_t sink = (uintptr_t)q;
+            (void)sink;
+            lat[b][c] = runner.Add(std::string("tlb ") + back.name + " " + std::to_string(counts[c]) + " pages", "ns", samples, false).stats.median;
+        }
+        munmap(map, map_size);
+    }
+
+    printf("%10s", "4K pages");
+    for(auto& back: backings)
+        printf(" | %10s", back.name);
+    printf("%s", "  ns per load\n");
+    for(size_t c = 0; c < counts.size(); ++c) {
+        printf("%10lld", (long long)counts[c]);
+        for(size_t b = 0; b < backings.size(); ++b) {
+            if (lat[b][c] < 0)
+                printf(" | %10s", "-");
+            else
+                printf(" | %10.2f", lat[b][c]);
+        }
+        printf("%s", "\n");
+    }
+
+    // 4K against the largest page available: same lines, the difference is translation
+    auto& small = lat[0];
+    size_t big = backings.size() - 1;
+    while(big > 0 && lat[big][0] < 0)
+        --big;
+    if (small[0] < 0 || big == 0)
+        return 0;
+    auto extra = [&](size_t c) { return small[c] - lat[big][c]; };
+    double max_extra = 0;
+    for(size_t c = 0; c < counts.size(); ++c)
+        max_extra = std::max(max_extra, extra(c));
+
+    // l1 dtlb reach: under 1 ns extra (an stlb hit is ~7 cycles). stlb reach: below half of the full page walk cost
+    int64_t l1_reach = 0, stlb_reach = 0;
+    double stlb_cost = 0;
+    for(size_t c = 0; c < counts.size() && extra(c) < 1.0; ++c)
+        l1_reach = counts[c];
+    for(size_t c = 0; c < counts.size(); ++c) {
+        if (extra(c) < max_extra * 0.5) {
+            stlb_reach = counts[c];
+            stlb_cost = extra(c);
+        }
+    }
+    printf("L1 dTLB reach ~%lld pages (%lld KB)\n", (long long)l1_reach, (long long)l1_reach * 4);
+    printf("STLB reach ~%lld pages (%lld MB), STLB hit ~%.1f ns\n", (long long)stlb_reach, (long long)stlb_reach * 4 / 1024, stlb_cost);
+    printf("page walk ~%.1f ns per load more than %s at worst\n", max_extra, backings[big].name);
+    return 0;
+}
+
+#else
+
+inline int RunTlb(bench::Runner&, int, char**) {
+    printf("%s", "tlb needs Linux (madvise, hugetlb).\n");
+    return 1;
+}
+
+#endif
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <thread>
+#include <algorithm>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/stat.h>
+#endif
+
+// cpu numbering from sysfs, everything falls back to "one package, all cpus" elsewhere
+struct CpuInfo {
+    int cpu;
+    int package;
+    int core;     // core_id, shared by smt siblings
+    int cluster;  // cpus sharing the last level cache (ccx on zen, the whole die on most intel)
+};
+
+inline std::vector<CpuInfo> CpuTopology() {
+    std::vector<CpuInfo> cpus;
+#ifdef __linux__
+    auto read_int = [](const std::string& path, int def) {
+        std::ifstream f(path);
+        int v;
+        return f >> v ? v : def;
+    };
+    auto read_str = [](const std::string& path) {
+        std::ifstream f(path);
+        std::string s;
+        std::getline(f, s);
+        return s;
+    };
+    std::vector<std::string> llc_ids;
+    for(int cpu = 0;; ++cpu) {
+        std::string dir = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+        struct stat st;
+        if (stat(dir.c_str(), &st) != 0)
+            break;
+        // offline cpus have no topology directory on most kernels
+        if (read_int(dir + "/online", 1) == 0 || !std::ifstream(dir + "/topology/core_id"))
+            continue;
+        CpuInfo c{ cpu, read_int(dir + "/topology/physical_package_id", 0), read_int(dir + "/topology/core_id", cpu), 0 };
+        // the highest cache index is the llc, its shared_cpu_list names the cluster
+        std::string llc;
+        for(int idx = 0; idx < 8; ++idx) {
+            auto list = read_str(dir + "/cache/index" + std::to_string(idx) + "/shared_cpu_list");
+            if (list.empty())
+                break;
+            llc = list;
+        }
+        auto it = std::find(llc_ids.begin(), llc_ids.end(), llc);
+        c.cluster = (int)(it - llc_ids.begin());
+        if (it == llc_ids.end())
+            llc_ids.push_back(llc);
+        cpus.push_back(c);
+    }
+#endif
+    if (cpus.empty()) {
+        int n = (int)std::max(1u, std::thread::hardware_concurrency());
+        for(int i = 0; i < n; ++i)
+            cpus.push_back(CpuInfo{ i, 0, i, 0 });
+    }
+    return cpus;
+}
+
+// run the calling thread on one cpu only, false if not supported
+inline bool PinThread(int cpu) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)cpu;
+    return false;
+#endif
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <array>
+#include <utility>
+#include <algorithm>
+
+#include "bench_runner.h"
+#include "timing_common.h"
+#include "dram_geometry.h"
+#include "line_kernels.h"
+
+// every order of the three address levels, generated at compile time
+//
+//   level 0  row     stride = row span (or any outer stride: bank, page), count = total / row
+//   level 1  line    stride = 64 (or any inner stride), count = row / line
+//   level 2  chunk   stride = 32, one avx2 load, count = line / 32
+//
+// a pattern is a permutation of the levels (outer to inner loop) and a direction per level:
+// 6 x 8 = 48 patterns. strides that are template arguments (line = 64, chunk = 32) make the
+// counts below the row constants, so the inner loops unroll; 0 means read at run time. the loop
+// nest itself (traversal_detail::Nest) is in line_kernels.h, the patterns mode orders use it too.
+
+namespace traversal_detail {
+
+constexpr int kPerms[6][3] = { { 0, 1, 2 }, { 0, 2, 1 }, { 1, 0, 2 }, { 1, 2, 0 }, { 2, 0, 1 }, { 2, 1, 0 } };
+constexpr int kPatterns = 6 * 8;
+constexpr const char* kLevelNames[3] = { "row", "line", "chunk" };
+
+// pattern I: permutation I / 8, bit l of I % 8 reverses address level l
+template<int I, int64_t Line, int64_t Chunk>
+uint64_t Pattern(const uint8_t* p, const TraversalLevels& lv) {
+    constexpr int a = kPerms[I / 8][0], b = kPerms[I / 8][1], c = kPerms[I / 8][2];
+    constexpr int dirs = I % 8;
+    LineAcc acc;
+    auto body = [&](int64_t off) { acc.Half(p + off); };
+    Nest<Line, Chunk, decltype(body), Loop<a, ((dirs >> a) & 1) != 0>, Loop<b, ((dirs >> b) & 1) != 0>, Loop<c, ((dirs >> c) & 1) != 0>>(lv, 0, body);
+    return acc.Fold();
+}
+
+using PatternFn = uint64_t (*)(const uint8_t*, const TraversalLevels&);
+
+template<int64_t Line, int64_t Chunk, size_t... I>
+constexpr std::array<PatternFn, kPatterns> MakeTable(std::index_sequence<I...>) {
+    return { { &Pattern<(int)I, Line, Chunk>... } };
+}
+
+template<int64_t Line, int64_t Chunk>
+constexpr std::array<PatternFn, kPatterns> kTable = MakeTable<Line, Chunk>(std::make_index_sequence<kPatterns>());
+
+// "row+ line+ chunk+", outer to inner, - is reverse
+inline std::string PatternName(int i) {
+    std::string name;
+    for(int k = 0; k < 3; ++k) {
+        int l = kPerms[i / 8][k];
+        name += std::string(k ? " " : "") + kLevelNames[l] + (((i % 8) >> l) & 1 ? "-" : "+");
+    }
+    return name;
+}
+
+} // namespace traversal_detail
+
+// mem-timing matrix [--ws=bytes] [--row=bytes] [--line=bytes]
+inline int RunTraversalMatrix(bench::Runner& runner, const DramGeometry& geo, int argc, char** argv) {
+    using namespace traversal_detail;
+    const int64_t row = ArgInt(argc, argv, "--row=", geo.rowsize);
+    const int64_t line = ArgInt(argc, argv, "--line=", 64);
+    if (line < 32 || line % 32 || row < line || row % line) {
+        printf("%s", "need 32 <= line, line a multiple of 32, row a multiple of line.\n");
+        return 1;
+    }
+    const int64_t ws = ArgInt(argc, argv, "--ws=", 1024 * 1024 * 1024) / row * row;
+    if (ws < row) {
+        printf("%s", "need ws >= row.\n");
+        return 1;
+    }
+
+    auto buf = (uint8_t*)AlignedAlloc(ws, std::max<int64_t>(row, 4096));
+    if (!buf) {
+        printf("%s", "out of memory.\n");
+        return 1;
+    }
+    AdviseHugePages(buf, ws);
+    for(int64_t i = 0; i < ws; i += 4096)
+        buf[i] = (uint8_t)i;
+
+    TraversalLevels lv = { { row, line, 32 }, { ws / row, row / line, line / 32 } };
+    // the default line size runs the unrolled instantiation
+    const auto& table = line == 64 ? kTable<64, 32> : kTable<0, 32>;
+    printf("row %lld, line %lld, chunk 32 bytes, %lld MB, %s loads\n", (long long)row, (long long)line, (long long)(ws >> 20), LineKernelIsa());
+
+    uint64_t sink = 0;
+    std::vector<double> gbps(kPatterns);
+    for(int i = 0; i < kPatterns; ++i) {
+        auto samples = bench::Collect(runner.options(), [&]() {
+            StopWatch w;
+            sink ^= table[i](buf, lv);
+            return (double)w.cost_ns();
+        });
+        double ns = runner.Add("matrix " + PatternName(i), "ns", samples, false).stats.median;
+        gbps[i] = ws / ns;
+        printf("  %-22s %8.2f GB/s\n", PatternName(i).c_str(), gbps[i]);
+        fflush(stdout);
+    }
+
+    // permutations down, directions across
+    printf("%-18s", "GB/s");
+    for(int d = 0; d < 8; ++d) {
+        char dirs[4] = { d & 1 ? '-' : '+', d & 2 ? '-' : '+', d & 4 ? '-' : '+', 0 };
+        printf(" | %5s", dirs);
+    }
+    printf("%s", "   (row line chunk)\n");
+    for(int p = 0; p < 6; ++p) {
+        printf("%-6s %-5s %-5s", kLevelNames[kPerms[p][0]], kLevelNames[kPerms[p][1]], kLevelNames[kPerms[p][2]]);
+        for(int d = 0; d < 8; ++d)
+            printf(" | %5.1f", gbps[p * 8 + d]);
+        printf("%s", "\n");
+    }
+    auto best = std::max_element(gbps.begin(), gbps.end()) - gbps.begin();
+    auto worst = std::min_element(gbps.begin(), gbps.end()) - gbps.begin();
+    printf("best %s %.2f GB/s, worst %s %.2f GB/s\n", PatternName((int)best).c_str(), gbps[best], PatternName((int)worst).c_str(), gbps[worst]);
+
+    volatile uint64_t keep = sink;
+    (void)keep;
+    AlignedFree(buf);
+    return 0;
+}
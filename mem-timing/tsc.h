@@ -0,0 +1,120 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "timing_common.h"
+
+#ifndef _MSC_VER
+#include <cpuid.h>
+#endif
+
+// time stamp counter reads around single loads
+//
+//   lfence; rdtsc; lfence   nothing before has to finish, nothing after starts early
+//   load
+//   rdtscp; lfence          rdtscp waits for the load, the lfence keeps later code out
+//
+// the tsc ticks at a fixed rate (invariant tsc), not the core clock: calibrate against steady_clock.
+
+inline uint64_t TscBegin() {
+    _mm_lfence();
+    uint64_t t = __rdtsc();
+    _mm_lfence();
+    return t;
+}
+
+inline uint64_t TscEnd() {
+    unsigned aux;
+    uint64_t t = __rdtscp(&aux);
+    _mm_lfence();
+    return t;
+}
+
+inline bool InvariantTsc() {
+    unsigned r[4];
+#ifdef _MSC_VER
+    __cpuid((int*)r, 0x80000000);
+    if (r[0] < 0x80000007)
+        return false;
+    __cpuid((int*)r, 0x80000007);
+#else
+    if (__get_cpuid_max(0x80000000, nullptr) < 0x80000007)
+        return false;
+    __cpuid(0x80000007, r[0], r[1], r[2], r[3]);
+#endif
+    return (r[3] >> 8) & 1;
+}
+
+struct TscClock {
+    double ghz = 0;          // ticks per ns
+    uint64_t overhead = 0;   // ticks of an empty TscBegin / TscEnd pair, min
+
+    // median of a few 20ms windows against steady_clock
+    static TscClock Calibrate() {
+        TscClock c;
+        std::vector<double> rates;
+        for(int i = 0; i < 7; ++i) {
+            StopWatch w;
+            uint64_t t0 = __rdtsc();
+            while(w.cost_ns() < 20 * 1000 * 1000)
+                ;
+            uint64_t t1 = __rdtsc();
+            rates.push_back((double)(t1 - t0) / w.cost_ns());
+        }
+        std::sort(rates.begin(), rates.end());
+        c.ghz = rates[rates.size() / 2];
+        c.overhead = UINT64_MAX;
+        for(int i = 0; i < 10000; ++i) {
+            uint64_t t0 = TscBegin();
+            uint64_t t1 = TscEnd();
+            c.overhead = std::min(c.overhead, t1 - t0);
+        }
+        return c;
+    }
+
+    double ns(uint64_t ticks) const {
+        return (ticks > overhead ? ticks - overhead : 0) / ghz;
+    }
+};
+
+// fixed width buckets over [lo, hi), with under / overflow counted apart
+class Histogram {
+    double lo_, width_;
+    std::vector<size_t> counts_;
+    size_t under_ = 0, over_ = 0, total_ = 0;
+
+public:
+    Histogram(double lo, double hi, int buckets) : lo_(lo), width_((hi - lo) / buckets), counts_(buckets) {}
+
+    void Add(double v) {
+        ++total_;
+        if (v < lo_)
+            ++under_;
+        else if (v >= lo_ + width_ * counts_.size())
+            ++over_;
+        else
+            ++counts_[(size_t)((v - lo_) / width_)];
+    }
+
+    size_t Count(size_t i) const { return counts_[i]; }
+    size_t Buckets() const { return counts_.size(); }
+    double Lower(size_t i) const { return lo_ + width_ * i; }
+
+    // one bar per bucket, scaled to the largest
+    void Print(const char* unit) const {
+        size_t peak = std::max<size_t>(1, *std::max_element(counts_.begin(), counts_.end()));
+        if (under_)
+            printf("  %8s < %-8.1f %8zu\n", "", lo_, under_);
+        for(size_t i = 0; i < counts_.size(); ++i) {
+            std::string bar(counts_[i] * 50 / peak, '#');
+            printf("  %8.1f .. %-8.1f %8zu %s\n", Lower(i), Lower(i + 1), counts_[i], bar.c_str());
+        }
+        if (over_)
+            printf("  %8s >= %-7.1f %8zu\n", "", lo_ + width_ * counts_.size(), over_);
+        printf("  %zu samples, %s\n", total_, unit);
+    }
+};
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <iterator>
+#include <algorithm>
+
+#include "bench_runner.h"
+#include "timing_common.h"
+#include "dram_geometry.h"
+#include "line_kernels.h"
+
+// the patterns orders with stores: temporal stores (read for ownership, then write back),
+// non-temporal stores, and reads and writes interleaved per access at fixed ratios
+//
+// the turnaround penalty of a mix is what it costs over the same accesses done apart:
+// measured / ((r * read + w * write) / (r + w)) - 1, write being the same store kind alone.
+// the controller batches writes, a penalty means the batching didn't hide the bus turnarounds.
+
+namespace write_patterns_detail {
+
+// `reads` reads then `writes` writes, repeating
+template<bool NonTemporal>
+struct LineMix {
+    LineAcc r;
+    LineWrite<NonTemporal> w;
+    int reads, period, k = 0;
+
+    LineMix(int reads, int writes) : reads(reads), period(reads + writes) {}
+
+    void Half(uint8_t* p) {
+        if (k < reads)
+            r.Half(p);
+        else
+            w.Half(p);
+        if (++k == period)
+            k = 0;
+    }
+
+    void Line(uint8_t* p) {
+        if (k < reads)
+            r.Line(p);
+        else
+            w.Line(p);
+        if (++k == period)
+            k = 0;
+    }
+};
+
+struct Kind {
+    const char* name;
+    int reads, writes;
+    bool nt;
+};
+
+} // namespace write_patterns_detail
+
+// mem-timing write [--ws=bytes]
+inline int RunWritePatterns(bench::Runner& runner, const DramGeometry& geo, int argc, char** argv) {
+    using namespace write_patterns_detail;
+    const int64_t rowsize = geo.rowsize;
+    const int64_t ws = ArgInt(argc, argv, "--ws=", 1024 * 1024 * 1024) / rowsize * rowsize;
+
+    auto buf = (uint8_t*)AlignedAlloc(ws, std::max<int64_t>(rowsize, 4096));
+    if (!buf) {
+        printf("%s", "out of memory.\n");
+        return 1;
+    }
+    AdviseHugePages(buf, ws);
+    memset(buf, 1, ws);
+
+    // reads:writes, temporal / non-temporal
+    const Kind kinds[] = {
+        { "read", 1, 0, false },
+        { "store", 0, 1, false },
+        { "nt store", 0, 1, true },
+        { "3:1", 3, 1, false },
+        { "1:1", 1, 1, false },
+        { "1:3", 1, 3, false },
+        { "3:1 nt", 3, 1, true },
+        { "1:1 nt", 1, 1, true },
+        { "1:3 nt", 1, 3, true },
+    };
+    constexpr size_t nkinds = sizeof(kinds) / sizeof(kinds[0]);
+
+    uint64_t sink = 0;
+    auto pass = [&](LineOrder o, const Kind& k) {
+        if (k.writes == 0) {
+            sink ^= ReadLines(o, buf, ws, rowsize);
+        } else if (k.nt) {
+            LineMix<true> m(k.reads, k.writes);
+            VisitLines(o, m, buf, ws, rowsize);
+            m.w.Done();
+            sink ^= m.r.Fold();
+        } else {
+            LineMix<false> m(k.reads, k.writes);
+            VisitLines(o, m, buf, ws, rowsize);
+            sink ^= m.r.Fold();
+        }
+    };
+
+    printf("%s loads / stores, %lld MB, row span %lld\n", LineKernelIsa(), (long long)(ws >> 20), (long long)rowsize);
+    // ns per pass: [order][kind]
+    std::vector<std::vector<double>> ns(std::size(kLineOrders), std::vector<double>(nkinds));
+    for(size_t o = 0; o < std::size(kLineOrders); ++o) {
+        for(size_t k = 0; k < nkinds; ++k) {
+            auto samples = bench::Collect(runner.options(), [&]() {
+                StopWatch w;
+                pass(kLineOrders[o], kinds[k]);
+                return (double)w.cost_ns();
+            });
+            ns[o][k] = runner.Add(std::string("write ") + LineOrderName(kLineOrders[o]) + " " + kinds[k].name, "ns", samples, false).stats.median;
+        }
+    }
+
+    // bytes touched per pass are the same for every kind of one order
+    printf("%-24s", "GB/s");
+    for(auto& k: kinds)
+        printf(" | %8s", k.name);
+    printf("%s", "\n");
+    for(size_t o = 0; o < std::size(kLineOrders); ++o) {
+        double bytes = kLineOrders[o] == LineOrder::RowSeqLineSkip ? ws / 2.0 : (double)ws;
+        printf("%-24s", LineOrderName(kLineOrders[o]));
+        for(size_t k = 0; k < nkinds; ++k)
+            printf(" | %8.2f", bytes / ns[o][k]);
+        printf("%s", "\n");
+    }
+
+    printf("\n%-24s | %8s", "turnaround penalty", "store/nt");
+    for(size_t k = 3; k < nkinds; ++k)
+        printf(" | %8s", kinds[k].name);
+    printf("%s", "\n");
+    for(size_t o = 0; o < std::size(kLineOrders); ++o) {
+        // store / nt store: what the read for ownership costs
+        printf("%-24s | %7.2fx", LineOrderName(kLineOrders[o]), ns[o][1] / ns[o][2]);
+        for(size_t k = 3; k < nkinds; ++k) {
+            double write = ns[o][kinds[k].nt ? 2 : 1];
+            double expected = (kinds[k].reads * ns[o][0] + kinds[k].writes * write) / (kinds[k].reads + kinds[k].writes);
+            printf(" | %+7.1f%%", (ns[o][k] / expected - 1) * 100);
+        }
+        printf("%s", "\n");
+    }
+
+    volatile uint64_t keep = sink;
+    (void)keep;
+    AlignedFree(buf);
+    return 0;
+}
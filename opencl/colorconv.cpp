@@ -13,6 +13,8 @@
 #include <future>
 #include <assert.h>
 
+#include "bench_runner.h"
+
 #ifdef _WIN32
 #include <windows.h>
 #endif
@@ -64,6 +66,9 @@ namespace {
     const int BM_MAP      = 0b00100000;
     int bufferMode_ = BM_DEVICE | BM_COPY;
 
+    bench::Runner* runner_ = nullptr;
+    std::string testName_ = "colorconv";
+
     size_t cl_mem_align() {
         return gmemAlign_;
         #if 0
@@ -715,6 +720,7 @@ void test() {
     size_t frames = 0;
     size_t iter_frames = 0;
     double fps = 60.0;
+    std::vector<double> fpsSamples; // one per second
 
     for(int ind = 0;; ++ind) {
         // pipeline mode or sync mode
@@ -725,8 +731,9 @@ void test() {
         auto diff = std::chrono::steady_clock::now() - begin;
         auto iter_diff = std::chrono::steady_clock::now() - iter_begin;
         if (iter_diff > std::chrono::seconds(1)) {
+            fpsSamples.push_back(iter_frames * 1000.0 / std::chrono::duration_cast<std::chrono::milliseconds>(iter_diff).count());
             fprintf(stderr, "fps = %g, avg = %g\n",
-                iter_frames * 1000.0 / std::chrono::duration_cast<std::chrono::milliseconds>(iter_diff).count(),
+                fpsSamples.back(),
                 frames * 1000.0 / std::chrono::duration_cast<std::chrono::milliseconds>(diff).count()
             );
             iter_begin = std::chrono::steady_clock::now();
@@ -774,9 +781,20 @@ void test() {
         q->enqueueMarkerWithWaitList(nullptr, &ev);
         ev.wait();
     }
+
+    if (fpsSamples.empty()) {
+        printf("%s: no fps samples\n", testName_.c_str());
+        return;
+    }
+    // drop the seconds before the frame rate settles
+    fpsSamples.erase(fpsSamples.begin(), fpsSamples.begin() + std::min(fpsSamples.size() - 1, bench::WarmupEnd(fpsSamples, runner_->options())));
+    runner_->Add(testName_, "fps", fpsSamples);
 }
 
-int main() {
+int main(int argc, char** argv) {
+    bench::Runner runner("colorconv", bench::Options::Parse(argc, argv));
+    runner_ = &runner;
+
     fprintf(stderr, "%s\n", "OpenCL Buffer? (0 = device buffer, 1 = svm buffer, 2 = host buffer, 3 = direct)");
     int bufferType;
     scanf("%d", &bufferType);
@@ -840,6 +858,9 @@ int main() {
         pipelineMode_ = 0; // 暂时还没做map模式下的流水线
     }
 
+    testName_ = "buffer mode " + std::to_string(bufferMode_) + ", reuse " + std::to_string(reuseBuffer_)
+        + ", host memory " + std::to_string(hostMemoryMode) + ", pipeline " + std::to_string(pipelineMode_);
+
     auto innerSwitch = [&](auto t) {
         using T = decltype(t);
         switch(hostMemoryMode) {
@@ -752,6 +752,6 @@ public:
 
 
 #include "colorconv_runtest.h"
-int main() {
-    return runtest<ColorConvD3D11>();
+int main(int argc, char** argv) {
+    return runtest<ColorConvD3D11>(argc, argv);
 }
@@ -522,6 +522,6 @@ public:
 
 
 #include "colorconv_runtest.h"
-int main() {
-    return runtest<ColorConvGLES>();
+int main(int argc, char** argv) {
+    return runtest<ColorConvGLES>(argc, argv);
 }
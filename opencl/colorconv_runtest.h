@@ -6,9 +6,12 @@
 #include <numeric>
 
 #include "speed_metrics.h"
+#include "bench_runner.h"
 
 template<class T>
-int runtest() try {
+int runtest(int argc, char** argv) try {
+    bench::Runner runner(argv[0], bench::Options::Parse(argc, argv));
+
     std::vector<uint32_t> inputBuffer1(1920 * 1920, 0xff800000); // Example input buffer
     std::vector<uint32_t> inputBuffer2(1920 * 1920, 0xff008000); // Example input buffer
     std::vector<uint8_t> outputYBuffer(1920 * 1920), outputUBuffer(1920 * 1920 / 4), outputVBuffer(1920 * 1920 / 4);
@@ -28,6 +31,8 @@ int runtest() try {
                 auto beginTime = high_resolution_clock::now();
                 auto iter_begin = beginTime;
                 int frameCount = 0;
+                int iterFrameCount = 0;
+                std::vector<double> fpsSamples; // one per second
                 for(;;) {
                     if (frameCount % 2)
                         colorConv.feedInput((char*)inputBuffer1.data());
@@ -48,8 +53,12 @@ int runtest() try {
 
                     colorConv.unmapResult();
                     ++frameCount;
+                    ++iterFrameCount;
 
                     if (steady_clock::now() - iter_begin > seconds(1)) {
+                        fpsSamples.push_back(iterFrameCount * 1000.0 /
+                            duration_cast<milliseconds>(steady_clock::now() - iter_begin).count());
+                        iterFrameCount = 0;
                         std::cout << "Processed " << 
                             (frameCount * 1000.0) / 
                                 duration_cast<milliseconds>(
@@ -96,6 +105,15 @@ int runtest() try {
                 }
                 std::cout << "In / Out memcpy (MB/s): " << colorConv.GetInputSpeedInMBps() << " / " << outSpeed.GetSpeedInMBps() << std::endl;
                 std::cout << "Error distance: " << errval * 1.0 / 2 << std::endl;
+
+                // drop the seconds before the frame rate settles
+                if (fpsSamples.empty()) {
+                    std::cout << "No fps samples" << std::endl;
+                } else {
+                    fpsSamples.erase(fpsSamples.begin(), fpsSamples.begin() + std::min(fpsSamples.size() - 1, bench::WarmupEnd(fpsSamples, runner.options())));
+                    runner.Add(std::string("compute shader ") + (i == 0 ? "yes" : "no") + ", map input " + (j == 0 ? "yes" : "no"), "fps", fpsSamples);
+                }
+                runner.Add(std::string("compute shader ") + (i == 0 ? "yes" : "no") + ", map input " + (j == 0 ? "yes" : "no") + " out memcpy", "MB/S", { outSpeed.GetSpeedInMBps() });
             };
             do_test();
         }
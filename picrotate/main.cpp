@@ -6,15 +6,31 @@
 #include <cmath>
 #include <functional>
 #include <random>
+#include <string>
+#include <algorithm>
 
 #include <new>
 
+#include "bench_runner.h"
+#include "machine_profile.h"
+#include "row_locality.h"
+
 const int width = 1920;
 const int height = 1920;
 
 using namespace std;
 
-int main() {
+int main(int argc, char** argv) {
+    bench::Options defaults;
+    defaults.max_seconds = 10;
+    bench::Runner runner("picrotate", bench::Options::Parse(argc, argv, defaults));
+
+    // tile sizes follow this machine's caches, `mem-timing cache` writes the profile
+    auto prof = MachineProfile::Load();
+    prof.Print();
+    const int l1 = (int)prof.l1d.size;
+    const int l2 = (int)prof.l2.size;
+
     std::random_device randev;
 
     int srcw = width;
@@ -68,28 +84,83 @@ int main() {
         }
     };
 
+    // the same tiles as cache_rotate, visited in a given order, tile = y * count + x
+    auto tile_size = [&](int cachesize) { return (int)sqrt(cachesize / mincachesize) * 16; };
+    auto order_rotate = [&](int cachesize, const std::vector<int>& order) {
+        int tile = tile_size(cachesize);
+        int count = (srcw + tile - 1) / tile;
+        for(int t: order) {
+            int y = t / count, x = t % count;
+            int endj = std::min((y + 1) * tile, srch);
+            int endi = std::min((x + 1) * tile, srcw);
+            for(int j = y * tile; j < endj; ++j)
+                for(int i = x * tile; i < endi; ++i)
+                    pdst[j * dstw + i] = psrc[i * srcw + j];
+        }
+    };
+    // what a tile touches: a column strip of src lines, a row strip of dst lines
+    auto tile_blocks = [&](int cachesize) {
+        int tile = tile_size(cachesize);
+        int count = (srcw + tile - 1) / tile;
+        RowBlocks blocks;
+        for(int y = 0; y < count; ++y) {
+            for(int x = 0; x < count; ++x) {
+                blocks.Begin();
+                int endj = std::min((y + 1) * tile, srch);
+                int endi = std::min((x + 1) * tile, srcw);
+                for(int i = x * tile; i < endi; ++i)
+                    blocks.Add(psrc + i * srcw + y * tile, (endj - y * tile) * 4);
+                for(int j = y * tile; j < endj; ++j)
+                    blocks.Add(pdst + j * dstw + x * tile, (endi - x * tile) * 4);
+            }
+        }
+        return blocks;
+    };
+
+    // one trial = enough frames for ~100ms, fps per trial
     auto do_test = [&](auto name, auto proc) {
         using namespace std::chrono;
         using clock = std::chrono::steady_clock;
-        auto begin = clock::now();
-        auto cost_time = clock::now() - begin;
-        int count = 0;
-        for(;;) {
-            proc();
-            ++count;
-
-            if (count % 100 == 0) {
-                cost_time = clock::now() - begin;
-                if (cost_time > seconds(10)) {
-                    printf("%s: avg: %g fps, %g MB/S\n", name, 
-                        count * 1e9 / duration_cast<nanoseconds>(cost_time).count(),
-                        count * (srcw * srch * 4 / 1e6) * 1e9 / duration_cast<nanoseconds>(cost_time).count()
-                    );
-                    break;
-                }
+        int frames = 1;
+        auto& r = runner.Run(name, "fps", [&]() {
+            auto begin = clock::now();
+            for(int i = 0; i < frames; ++i)
+                proc();
+            double cost = duration_cast<nanoseconds>(clock::now() - begin).count() / 1e9;
+            double fps = frames / cost;
+            frames = std::max(1, (int)(fps / 10));
+            return fps;
+        });
+        std::vector<double> mbps;
+        for(auto fps: r.samples)
+            mbps.push_back(fps * (srcw * srch * 4 / 1e6));
+        runner.Add(std::string(name) + " bandwidth", "MB/S", mbps);
+    };
+
+    // dram rows from the profile, bank functions from `mem-timing addrmap` if given
+    RowLocality loc = RowLocality::FromProfile(prof);
+    for(int i = 1; i < argc; ++i) {
+        if (strncmp(argv[i], "--banks=", 8) == 0) {
+            auto functions = RowLocality::ParseBankFunctions(argv[i] + 8);
+            if (functions.empty()) {
+                _aligned_free(psrc);
+                _aligned_free(pdst);
+                return 1;
             }
+            loc = RowLocality(prof.dram_rowsize, 0, functions);
         }
-    };
+    }
+    int tiles = (srcw + tile_size(l1) - 1) / tile_size(l1);
+    std::vector<int> row_major, column_major;
+    for(int t = 0; t < tiles * tiles; ++t) {
+        row_major.push_back(t);
+        column_major.push_back(t % tiles * tiles + t / tiles);
+    }
+    auto blocks = tile_blocks(l1);
+    auto row_locality = loc.Optimize(blocks, column_major);
+    printf("row buffer model, row %lld, %d banks: row major %.1f%%, column major %.1f%%, row locality %.1f%% hits\n",
+        (long long)loc.rowsize(), loc.banks(), loc.Score(blocks, row_major).HitRate() * 100,
+        loc.Score(blocks, column_major).HitRate() * 100, loc.Score(blocks, row_locality).HitRate() * 100);
 
     // 热身
     std::vector<uint32_t> chk(dstw * dsth * 4);
@@ -100,13 +171,20 @@ int main() {
     memcpy(chk.data(), pdst, dstw * dsth * 4);
     memset(pdst, 0, dstw * dsth * 4);
     cache_rotate(mincachesize);
-    if (memcmp(chk.data(), pdst, dstw * dsth * 4) == 0) {
+    bool ok = memcmp(chk.data(), pdst, dstw * dsth * 4) == 0;
+    memset(pdst, 0, dstw * dsth * 4);
+    order_rotate(l1, row_locality);
+    ok = ok && memcmp(chk.data(), pdst, dstw * dsth * 4) == 0;
+    if (ok) {
         do_test("sequence read", seqr_rotate);
         do_test("sequence write", seqw_rotate);
         do_test("2K cached", std::bind(cache_rotate, mincachesize));
-        do_test("L1 cached", std::bind(cache_rotate, 32768));
-        do_test("4x L1 cached", std::bind(cache_rotate, 4 * 32768));
-        do_test("L2 cached", std::bind(cache_rotate, 1048576 * 2));
+        do_test("L1 cached", std::bind(cache_rotate, l1));
+        do_test("4x L1 cached", std::bind(cache_rotate, 4 * l1));
+        do_test("L2 cached", std::bind(cache_rotate, l2));
+        do_test("L1 tiles, row major", [&]() { order_rotate(l1, row_major); });
+        do_test("L1 tiles, column major", [&]() { order_rotate(l1, column_major); });
+        do_test("L1 tiles, row locality", [&]() { order_rotate(l1, row_locality); });
     } else {
         printf("%s", "incorrect cached rw implementation.\n");
     }